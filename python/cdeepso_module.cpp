@@ -0,0 +1,498 @@
+// Python bindings of CDEEPSOParams and CDEEPSO.
+//
+// The objective is a Python callable eval(x, mask, fitness) called once per
+// batch. x is the (rows, dims) particle block, mask flags the rows that need
+// a fitness and fitness receives them, all three are NumPy views of the
+// optimizer buffers, no copy is made. x and mask are read-only and none of
+// them may be kept after the call returns. An optional constraint(x, mask,
+// violation) writes the total violation, 0 when feasible, as in -constraint.
+//
+// The optimizer runs with the GIL released and takes it back only around the
+// callbacks.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION
+#include <numpy/arrayobject.h>
+
+#include "cdeepso.hpp"
+
+#include <sstream>
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Callbacks
+//////////////////////////////////////////////////////////////////////////////////////////
+
+// Thrown through the optimizer when a callback raised, the Python error is
+// kept in PythonCall until the GIL is back in the calling thread
+class PythonError
+{
+
+};
+
+class PythonCall
+{
+public:
+
+    PyObject * type = nullptr;
+    PyObject * value = nullptr;
+    PyObject * traceback = nullptr;
+
+    // Must hold the GIL
+    void
+    fetch()
+    {
+        PyErr_Fetch(&type, &value, &traceback);
+    }
+
+    bool
+    failed() const
+    {
+        return type != nullptr;
+    }
+
+    void
+    restore()
+    {
+        PyErr_Restore(type, value, traceback);
+        type = value = traceback = nullptr;
+    }
+};
+
+// Calls fn(x, mask, out) for the refreshed rows of particles. The mask is the
+// only copy, Refreshes is a bit vector
+class PythonBatch
+{
+public:
+
+    PyObject * fn;
+    PythonCall * call;
+    vector<npy_bool> mask;
+
+public:
+
+    PythonBatch(PyObject * fn, PythonCall * call) :
+        fn(fn),
+        call(call)
+    {
+
+    }
+
+    void
+    operator()(Particles & particles,
+               Refreshes & refresh,
+               vector<Precision> & out)
+    {
+        const npy_intp rows = particles.numRows();
+        npy_intp shape[2] = {rows, npy_intp(particles.numCols())};
+
+        mask.resize(rows);
+        bool any = false;
+        for (npy_intp i=0;i!=rows;++i)
+            any |= (mask[i] = refresh[i]);
+
+        if (!any)
+            return;
+
+        PyGILState_STATE gil = PyGILState_Ensure();
+
+        PyObject * x = PyArray_SimpleNewFromData(2, shape, NPY_DOUBLE, &particles(0,0));
+        PyObject * m = PyArray_SimpleNewFromData(1, shape, NPY_BOOL, &mask[0]);
+        PyObject * o = PyArray_SimpleNewFromData(1, shape, NPY_DOUBLE, &out[0]);
+        PyObject * result = nullptr;
+
+        if (x && m && o)
+        {
+            PyArray_CLEARFLAGS(reinterpret_cast<PyArrayObject*>(x), NPY_ARRAY_WRITEABLE);
+            PyArray_CLEARFLAGS(reinterpret_cast<PyArrayObject*>(m), NPY_ARRAY_WRITEABLE);
+            result = PyObject_CallFunctionObjArgs(fn, x, m, o, nullptr);
+        }
+
+        Py_XDECREF(result);
+        Py_XDECREF(x);
+        Py_XDECREF(m);
+        Py_XDECREF(o);
+
+        const bool failed = result == nullptr;
+        if (failed)
+            call->fetch();
+
+        PyGILState_Release(gil);
+
+        if (failed)
+            throw PythonError();
+    }
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// CDEEPSOParams
+//////////////////////////////////////////////////////////////////////////////////////////
+
+struct PyParams
+{
+    PyObject_HEAD
+    CDEEPSOParams * params;
+};
+
+// Every keyword becomes the matching command line flag, CDEEPSOParams(dims=30,
+// deType="RAND") is the same as -dims 30 -deType RAND
+static int
+PyParams_init(PyParams * self, PyObject * args, PyObject * kwargs)
+{
+    if (PyTuple_Size(args) != 0)
+    {
+        PyErr_SetString(PyExc_TypeError, "CDEEPSOParams only takes keyword arguments");
+        return -1;
+    }
+
+    vector<std::string> tokens(1, "cdeepso");
+    PyObject * key;
+    PyObject * value;
+    Py_ssize_t pos = 0;
+
+    while (kwargs && PyDict_Next(kwargs, &pos, &key, &value))
+    {
+        PyObject * text = PyObject_Str(value);
+        if (!text)
+            return -1;
+
+        tokens.push_back(std::string("-") + PyUnicode_AsUTF8(key));
+        tokens.push_back(PyUnicode_AsUTF8(text));
+        Py_DECREF(text);
+    }
+
+    vector<const char*> argv;
+    for (auto & t : tokens)
+        argv.push_back(t.c_str());
+
+    // Optimizers keep a reference to the params they were built with
+    if (self->params)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "CDEEPSOParams is already initialized");
+        return -1;
+    }
+
+    try
+    {
+        Params params(argv.size(), argv.data());
+        self->params = new CDEEPSOParams(params);
+    }
+    catch (std::exception & e)
+    {
+        PyErr_SetString(PyExc_ValueError, e.what());
+        return -1;
+    }
+
+    return 0;
+}
+
+static void
+PyParams_dealloc(PyParams * self)
+{
+    delete self->params;
+    Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+}
+
+static PyObject *
+PyParams_display(PyParams * self, PyObject *)
+{
+    if (!self->params)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "CDEEPSOParams is not initialized");
+        return nullptr;
+    }
+
+    self->params->display();
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef PyParams_methods[] = {
+    {"display", reinterpret_cast<PyCFunction>(PyParams_display), METH_NOARGS, "Prints every parameter"},
+    {nullptr, nullptr, 0, nullptr}
+};
+
+static PyTypeObject PyParamsType = {
+    PyVarObject_HEAD_INIT(nullptr, 0)
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// CDEEPSO
+//////////////////////////////////////////////////////////////////////////////////////////
+
+struct PyOptimizer
+{
+    PyObject_HEAD
+    PyParams * params;
+    CDEEPSO * optimizer;
+    bool ran;
+};
+
+static int
+PyOptimizer_init(PyOptimizer * self, PyObject * args, PyObject *)
+{
+    PyObject * params;
+
+    if (!PyArg_ParseTuple(args, "O!", &PyParamsType, &params))
+        return -1;
+
+    if (!reinterpret_cast<PyParams*>(params)->params)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "CDEEPSOParams is not initialized");
+        return -1;
+    }
+
+    // CDEEPSO keeps a reference to its params
+    Py_INCREF(params);
+    Py_XDECREF(self->params);
+    self->params = reinterpret_cast<PyParams*>(params);
+
+    delete self->optimizer;
+    self->optimizer = nullptr;
+    self->ran = false;
+
+    try
+    {
+        self->optimizer = new CDEEPSO(*self->params->params);
+    }
+    catch (std::exception & e)
+    {
+        PyErr_SetString(PyExc_ValueError, e.what());
+        return -1;
+    }
+
+    return 0;
+}
+
+// False, with a Python error set, when __init__ did not run or failed
+static bool
+initialized(PyOptimizer * self)
+{
+    if (self->optimizer)
+        return true;
+
+    PyErr_SetString(PyExc_RuntimeError, "CDEEPSO is not initialized");
+    return false;
+}
+
+static void
+PyOptimizer_dealloc(PyOptimizer * self)
+{
+    delete self->optimizer;
+    Py_XDECREF(self->params);
+    Py_TYPE(self)->tp_free(reinterpret_cast<PyObject*>(self));
+}
+
+static PyObject *
+PyOptimizer_optimize(PyOptimizer * self, PyObject * args, PyObject * kwargs)
+{
+    static const char * keywords[] = {"eval", "constraint", nullptr};
+    PyObject * eval;
+    PyObject * constraint = Py_None;
+
+    if (!initialized(self) || !PyArg_ParseTupleAndKeywords(args, kwargs, "O|O", const_cast<char**>(keywords), &eval, &constraint))
+        return nullptr;
+
+    if (!PyCallable_Check(eval) || (constraint != Py_None && !PyCallable_Check(constraint)))
+    {
+        PyErr_SetString(PyExc_TypeError, "eval and constraint must be callable");
+        return nullptr;
+    }
+
+    // The budget of a CDEEPSO is spent by its run
+    if (self->ran)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "optimize already ran, create a new CDEEPSO for another run");
+        return nullptr;
+    }
+
+    self->ran = true;
+
+    PythonCall call;
+    std::string failure;
+    CDEEPSO & m = *self->optimizer;
+    CDEEPSOParams const & p = *self->params->params;
+    EliteSet warm;
+
+    Py_BEGIN_ALLOW_THREADS
+
+    try
+    {
+        // Warm start and elite set as in the command line, loadElite and
+        // saveElite params
+        if (!p.loadElite.empty())
+            warm.load(p.loadElite);
+
+        m.setWarmStart(warm.empty() ? nullptr : &warm);
+
+        if (constraint == Py_None)
+            m.optimize(PythonBatch(eval, &call));
+        else
+            m.optimize(constrained(PythonBatch(eval, &call), PythonBatch(constraint, &call)));
+
+        if (!p.saveElite.empty())
+            m.elite(p.eliteSize).save(p.saveElite);
+    }
+    catch (PythonError &)
+    {
+
+    }
+    catch (std::exception & e)
+    {
+        failure = e.what();
+    }
+
+    // warm goes out of scope on every path
+    m.setWarmStart(nullptr);
+
+    Py_END_ALLOW_THREADS
+
+    if (call.failed())
+    {
+        call.restore();
+        return nullptr;
+    }
+
+    if (!failure.empty())
+    {
+        PyErr_SetString(PyExc_RuntimeError, failure.c_str());
+        return nullptr;
+    }
+
+    return PyFloat_FromDouble(m.gBestFit);
+}
+
+static PyObject *
+PyOptimizer_gBest(PyOptimizer * self, void *)
+{
+    if (!initialized(self))
+        return nullptr;
+
+    vector<Precision> const & gBest = self->optimizer->gBest;
+    npy_intp shape[1] = {npy_intp(gBest.size())};
+
+    PyObject * array = PyArray_SimpleNew(1, shape, NPY_DOUBLE);
+    if (array)
+        std::copy(gBest.begin(), gBest.end(), static_cast<Precision*>(PyArray_DATA(reinterpret_cast<PyArrayObject*>(array))));
+    return array;
+}
+
+static PyObject *
+PyOptimizer_gBestFit(PyOptimizer * self, void *)
+{
+    if (!initialized(self))
+        return nullptr;
+
+    return PyFloat_FromDouble(self->optimizer->gBestFit);
+}
+
+static PyObject *
+PyOptimizer_gBestViolation(PyOptimizer * self, void *)
+{
+    if (!initialized(self))
+        return nullptr;
+
+    return PyFloat_FromDouble(self->optimizer->gBestViolation);
+}
+
+static PyObject *
+PyOptimizer_fitEval(PyOptimizer * self, void *)
+{
+    if (!initialized(self))
+        return nullptr;
+
+    return PyLong_FromLong(self->optimizer->fitEval);
+}
+
+// Safe to call from another Python thread while optimize runs, the getters
+// above are only meant for after the run
+static PyObject *
+PyOptimizer_best(PyOptimizer * self, PyObject *)
+{
+    if (!initialized(self))
+        return nullptr;
+
+    vector<Precision> x;
+    Precision f, v;
+    int evals;
+
+    self->optimizer->anytime.snapshot(x, f, v, evals);
+
+    npy_intp shape[1] = {npy_intp(x.size())};
+    PyObject * array = PyArray_SimpleNew(1, shape, NPY_DOUBLE);
+    if (!array)
+        return nullptr;
+
+    std::copy(x.begin(), x.end(), static_cast<Precision*>(PyArray_DATA(reinterpret_cast<PyArrayObject*>(array))));
+    return Py_BuildValue("(Nddi)", array, f, v, evals);
+}
+
+static PyMethodDef PyOptimizer_methods[] = {
+    {"optimize", reinterpret_cast<PyCFunction>(reinterpret_cast<void(*)()>(PyOptimizer_optimize)), METH_VARARGS | METH_KEYWORDS,
+     "optimize(eval, constraint=None) runs the optimizer and returns the best fitness"},
+    {"best", reinterpret_cast<PyCFunction>(PyOptimizer_best), METH_NOARGS,
+     "best() returns (gBest, gBestFit, gBestViolation, fitEval) of the running optimization"},
+    {nullptr, nullptr, 0, nullptr}
+};
+
+static PyGetSetDef PyOptimizer_getset[] = {
+    {"gBest", reinterpret_cast<getter>(PyOptimizer_gBest), nullptr, "Best position, a copy", nullptr},
+    {"gBestFit", reinterpret_cast<getter>(PyOptimizer_gBestFit), nullptr, "Best fitness", nullptr},
+    {"gBestViolation", reinterpret_cast<getter>(PyOptimizer_gBestViolation), nullptr, "Violation of gBest", nullptr},
+    {"fitEval", reinterpret_cast<getter>(PyOptimizer_fitEval), nullptr, "Fitness evaluations spent", nullptr},
+    {nullptr, nullptr, nullptr, nullptr, nullptr}
+};
+
+static PyTypeObject PyOptimizerType = {
+    PyVarObject_HEAD_INIT(nullptr, 0)
+};
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Module
+//////////////////////////////////////////////////////////////////////////////////////////
+
+static PyModuleDef module = {
+    PyModuleDef_HEAD_INIT, "cdeepso", "C-DEEPSO optimizer", -1, nullptr, nullptr, nullptr, nullptr, nullptr
+};
+
+PyMODINIT_FUNC
+PyInit_cdeepso()
+{
+    import_array();
+
+    PyParamsType.tp_name = "cdeepso.CDEEPSOParams";
+    PyParamsType.tp_basicsize = sizeof(PyParams);
+    PyParamsType.tp_flags = Py_TPFLAGS_DEFAULT;
+    PyParamsType.tp_doc = "CDEEPSOParams(**options), options as in the command line flags";
+    PyParamsType.tp_new = PyType_GenericNew;
+    PyParamsType.tp_init = reinterpret_cast<initproc>(PyParams_init);
+    PyParamsType.tp_dealloc = reinterpret_cast<destructor>(PyParams_dealloc);
+    PyParamsType.tp_methods = PyParams_methods;
+
+    PyOptimizerType.tp_name = "cdeepso.CDEEPSO";
+    PyOptimizerType.tp_basicsize = sizeof(PyOptimizer);
+    PyOptimizerType.tp_flags = Py_TPFLAGS_DEFAULT;
+    PyOptimizerType.tp_doc = "CDEEPSO(params)";
+    PyOptimizerType.tp_new = PyType_GenericNew;
+    PyOptimizerType.tp_init = reinterpret_cast<initproc>(PyOptimizer_init);
+    PyOptimizerType.tp_dealloc = reinterpret_cast<destructor>(PyOptimizer_dealloc);
+    PyOptimizerType.tp_methods = PyOptimizer_methods;
+    PyOptimizerType.tp_getset = PyOptimizer_getset;
+
+    if (PyType_Ready(&PyParamsType) < 0 || PyType_Ready(&PyOptimizerType) < 0)
+        return nullptr;
+
+    PyObject * m = PyModule_Create(&module);
+    if (!m)
+        return nullptr;
+
+    Py_INCREF(&PyParamsType);
+    Py_INCREF(&PyOptimizerType);
+    PyModule_AddObject(m, "CDEEPSOParams", reinterpret_cast<PyObject*>(&PyParamsType));
+    PyModule_AddObject(m, "CDEEPSO", reinterpret_cast<PyObject*>(&PyOptimizerType));
+    return m;
+}
@@ -0,0 +1,17 @@
+# Builds the cdeepso extension module: pip install ./python
+import numpy
+from setuptools import Extension, setup
+
+setup(
+    name="cdeepso",
+    version="0.1",
+    ext_modules=[
+        Extension(
+            "cdeepso",
+            ["cdeepso_module.cpp"],
+            include_dirs=["../src", "../wup/cpp/include", numpy.get_include()],
+            extra_compile_args=["-std=c++11", "-O3"],
+            libraries=["pthread"],
+        )
+    ],
+)
@@ -0,0 +1,89 @@
+#ifndef ANYTIME_HPP
+#define ANYTIME_HPP
+
+#include "cdeepso_params.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+// Copy of the gBest of a run that other threads may read at any moment, e.g.
+// to answer a request before the run is over. The run publishes every change
+// of gBest under a mutex and readers copy it out under the same mutex, so a
+// snapshot never mixes the position of one solution with the fitness of
+// another. The mutex is only taken when gBest is merged, a few times per
+// generation.
+class AnytimeBest
+{
+public:
+
+    mutable std::mutex mutex;
+
+    std::vector<Precision> position;
+    Precision fitness;
+    Precision violation;
+    int fitEval;
+    long version;
+
+public:
+
+    AnytimeBest(int const dims) :
+        position(dims),
+        fitness(std::numeric_limits<Precision>::infinity()),
+        violation(std::numeric_limits<Precision>::infinity()),
+        fitEval(0),
+        version(0)
+    {
+
+    }
+
+    void
+    reset()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        std::fill(position.begin(), position.end(), 0.0);
+        fitness = std::numeric_limits<Precision>::infinity();
+        violation = std::numeric_limits<Precision>::infinity();
+        fitEval = 0;
+        version = 0;
+    }
+
+    void
+    publish(std::vector<Precision> const & x,
+            Precision const f,
+            Precision const v,
+            int const evals)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (version && f == fitness && v == violation)
+            return;
+
+        std::copy(x.begin(), x.end(), position.begin());
+        fitness = f;
+        violation = v;
+        fitEval = evals;
+        ++version;
+    }
+
+    // Returns the number of publications so far, 0 before the first one
+    long
+    snapshot(std::vector<Precision> & x,
+             Precision & f,
+             Precision & v,
+             int & evals) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        x = position;
+        f = fitness;
+        v = violation;
+        evals = fitEval;
+
+        return version;
+    }
+};
+
+#endif // ANYTIME_HPP
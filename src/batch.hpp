@@ -0,0 +1,134 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include "population.hpp"
+
+#include <fstream>
+#include <mutex>
+#include <sstream>
+
+// Queue of jobs read from a batch file and executed in a single process. Each
+// line of the file is one job written with the command line flags, applied on
+// top of the flags given to the binary, e.g.
+//
+//     # function, dims, bounds, strategy, budget and seeds per job
+//     -eval ras -dims 30 -deType RAND -maxFitEval 20000 -maxRun 10 -seed 1
+//     -eval ros -boundsFile ros.bounds -maxRun 5 -seed 100
+//
+// Empty lines and lines starting with # are ignored. Every run of every job
+// becomes a task and all tasks share one pool of p.threads workers. Results
+// are appended to the output as soon as a run ends, one CSV line per run.
+class Batch
+{
+public:
+
+    class Task
+    {
+    public:
+        int job;
+        int run;
+    };
+
+    CDEEPSOParams & p;
+
+    vector<CDEEPSOParams> jobs;
+    vector<Task> tasks;
+
+    std::ofstream out;
+    std::mutex outMutex;
+
+public:
+
+    Batch(CDEEPSOParams & p) :
+        p(p)
+    {
+
+    }
+
+    void
+    load(std::string const & filename)
+    {
+        std::ifstream in(filename);
+
+        if (!in.good())
+            error("Could not open batch file:", filename);
+
+        std::string line;
+
+        while (std::getline(in, line))
+        {
+            const size_t first = line.find_first_not_of(" \t\r");
+
+            if (first == std::string::npos || line[first] == '#')
+                continue;
+
+            std::stringstream ss(line);
+            vector<std::string> tokens(1, "batch");
+            std::string token;
+
+            while (ss >> token)
+                tokens.push_back(token);
+
+            vector<const char*> argv;
+            for (auto & t : tokens)
+                argv.push_back(t.c_str());
+
+            Params params(argv.size(), argv.data());
+            CDEEPSOParams jp = p;
+            jp.batch = "";
+            jp.printConvergenceResults = 0;
+            jp.parseParams(params);
+
+            if (!jp.loadElite.empty() || !jp.saveElite.empty())
+                error("Warm starts are not supported in batch mode:", line);
+
+            // Options of a whole invocation, a job would silently drop them
+            if (jp.race || !jp.traceFile.empty() || !jp.sharedFile.empty() || jp.numa ||
+                    jp.planner || !jp.experiment.empty() || jp.trafficBench > 0 || jp.batchOut != p.batchOut)
+                error("Option not supported in batch mode:", line);
+
+            // Unseeded jobs draw their seed here, so the CSV can replay them
+            if (!jp.seed)
+                jp.seed = 1 + int(Random::freshSeed() % 1000000000);
+
+            for (int r=0;r!=jp.maxRun;++r)
+                tasks.push_back(Task{int(jobs.size()), r});
+
+            jobs.push_back(jp);
+        }
+    }
+
+    // runner(job, params, run) executes one run and returns its RunResult
+    template <typename RUNNER>
+    void
+    run(std::string const & filename,
+        RUNNER runner)
+    {
+        out.open(filename);
+
+        if (!out.good())
+            error("Could not write batch results:", filename);
+
+        out << "job,run,seed,eval,dims,fitness,violation,fitEval,millis\n";
+        out.flush();
+
+        wup::parallel(p.threads, tasks.size(), [&](const int tid, const int jid) {
+            UNUSED(tid);
+
+            Task const & task = tasks[jid];
+            CDEEPSOParams & jp = jobs[task.job];
+            Clock c;
+
+            auto result = runner(task.job, jp, task.run);
+            const long double millis = c.stop().ellapsed_milli();
+
+            std::lock_guard<std::mutex> lock(outMutex);
+            out << task.job << "," << task.run << "," << jp.seed + task.run << ","
+                << jp.eval << "," << jp.dims << "," << result.gBestFit << ","
+                << result.gBestViolation << "," << result.fitEval << "," << millis << "\n";
+            out.flush();
+        });
+    }
+};
+
+#endif // BATCH_HPP
@@ -0,0 +1,283 @@
+#ifndef CCDEEPSO_HPP
+#define CCDEEPSO_HPP
+
+#include "cdeepso.hpp"
+#include "functions.hpp"
+
+#include <memory>
+
+// Cooperative coevolution for high dimensional problems. The dimensions are
+// split in contiguous blocks of p.blockSize and each block is optimized by its
+// own CDEEPSO sub-swarm. A sub-swarm particle is evaluated by writing it into
+// the context vector, the best complete solution found so far (gBest).
+//
+// When the objective is separable only the block terms are recomputed, so an
+// evaluation costs O(blockSize) instead of O(dims), and the sub-swarms are
+// rebased with a fitness shift instead of being evaluated again.
+class CCDEEPSO
+{
+public:
+
+    class BlockEval
+    {
+    public:
+
+        CCDEEPSO & cc;
+        int const block;
+
+        BlockEval(CCDEEPSO & cc, int const block) :
+            cc(cc), block(block) { }
+
+        void
+        operator()(Particles & particles,
+                   Refreshes & refresh,
+                   Fitness & fitness)
+        {
+            for (uint i=0;i!=particles.numRows();++i)
+                if (refresh[i])
+                    fitness[i] = cc.evalInContext(block, &particles(i,0));
+        }
+    };
+
+    CDEEPSOParams & p;
+    Objective objective;
+
+    vector<int> blockStart;
+    vector<CDEEPSOParams> blockParams;
+    vector<std::unique_ptr<CDEEPSO>> swarms;
+    vector<Precision> blockRest;
+    vector<int> blockVersion;
+
+    vector<Precision> xMin;
+    vector<Precision> xMax;
+
+    Precision gBestFit;
+    vector<Precision> gBest;
+    vector<Precision> gBestTerms;
+    vector<Precision> scratch;
+    int version;
+
+    int fitEval;
+
+    ConvergenceTrace trace;
+    Random generator;
+
+public:
+
+    CCDEEPSO(CDEEPSOParams & p, Objective const & objective) :
+        p(p),
+        objective(objective),
+        xMin(p.dims),
+        xMax(p.dims),
+        gBestFit(-1.0),
+        gBest(p.dims),
+        gBestTerms(p.dims),
+        scratch(p.dims),
+        version(0),
+        fitEval(0),
+        trace(p.tracePoints, p.popSize, p.maxFitEval),
+        generator(p.seed)
+    {
+        if (p.blockSize <= 0)
+            error("blockSize must be positive in cooperative mode");
+
+        vector<double> vMin(p.dims);
+        vector<double> vMax(p.dims);
+        ops::initLimits(p, xMin, xMax, vMin, vMax);
+
+        for (int first=0;first<p.dims;first+=p.blockSize)
+            blockStart.push_back(first);
+        blockStart.push_back(p.dims);
+
+        const int blocks = numBlocks();
+
+        // CDEEPSO keeps a reference to its params, they must not be relocated
+        blockParams.resize(blocks, p);
+        blockRest.resize(blocks, 0.0);
+        blockVersion.resize(blocks, -1);
+
+        for (int b=0;b!=blocks;++b)
+        {
+            sliceParams(b, blockParams[b]);
+            swarms.push_back(std::unique_ptr<CDEEPSO>(new CDEEPSO(blockParams[b])));
+        }
+    }
+
+    int
+    numBlocks() const
+    {
+        return int(blockStart.size()) - 1;
+    }
+
+    int
+    blockLen(int const b) const
+    {
+        return blockStart[b+1] - blockStart[b];
+    }
+
+    void
+    sliceParams(int const b,
+                CDEEPSOParams & bp) const
+    {
+        const int first = blockStart[b];
+        const int last = blockStart[b+1];
+
+        bp.dims = last - first;
+        bp.seed = Random::derive(p.seed, b);
+        bp.tracePoints = 0;
+
+        if (!p.dimMin.empty())
+        {
+            bp.dimMin.assign(p.dimMin.begin() + first, p.dimMin.begin() + last);
+            bp.dimMax.assign(p.dimMax.begin() + first, p.dimMax.begin() + last);
+        }
+
+        bp.intDims.clear();
+        for (uint k=0;k!=p.intDims.size();++k)
+            if (p.intDims[k] >= first && p.intDims[k] < last)
+                bp.intDims.push_back(p.intDims[k] - first);
+    }
+
+    Precision
+    evalInContext(int const b,
+                  Precision const * const x)
+    {
+        const int first = blockStart[b];
+        const int len = blockLen(b);
+
+        if (objective.separable())
+        {
+            Precision fit = blockRest[b];
+            for (int j=0;j!=len;++j)
+                fit += objective.term(x[j], first + j);
+            return fit;
+        }
+
+        std::copy(x, x + len, scratch.begin() + first);
+        const Precision fit = objective(scratch.data(), p.dims);
+        std::copy(gBest.begin() + first, gBest.begin() + first + len, scratch.begin() + first);
+        return fit;
+    }
+
+    void
+    initContext()
+    {
+        for (int j=0;j!=p.dims;++j)
+            gBest[j] = xMin[j] + (xMax[j] - xMin[j]) * generator.uniformDouble();
+
+        for (uint k=0;k!=p.intDims.size();++k)
+        {
+            const int j = p.intDims[k];
+            gBest[j] = std::min(std::floor(xMax[j]), std::max(std::ceil(xMin[j]), std::round(gBest[j])));
+        }
+
+        scratch = gBest;
+        gBestFit = objective(gBest.data(), p.dims);
+        fitEval += 1;
+
+        if (objective.separable())
+            for (int j=0;j!=p.dims;++j)
+                gBestTerms[j] = objective.term(gBest[j], j);
+    }
+
+    Precision
+    contextRest(int const b) const
+    {
+        Precision rest = gBestFit;
+        for (int j=blockStart[b];j!=blockStart[b+1];++j)
+            rest -= gBestTerms[j];
+        return rest;
+    }
+
+    // Brings the stored fitness of a sub-swarm up to date with the context
+    void
+    rebase(int const b)
+    {
+        CDEEPSO & swarm = *swarms[b];
+
+        if (blockVersion[b] == version)
+            return;
+
+        if (objective.separable())
+        {
+            const Precision rest = contextRest(b);
+
+            if (blockVersion[b] != -1)
+                swarm.shiftFitness(rest - blockRest[b]);
+
+            blockRest[b] = rest;
+        }
+
+        BlockEval eval(*this, b);
+        const int oldFitEval = swarm.fitEval;
+
+        if (blockVersion[b] == -1)
+            swarm.start(eval);
+
+        else if (!objective.separable())
+            swarm.reevaluate(eval);
+
+        fitEval += swarm.fitEval - oldFitEval;
+        blockVersion[b] = version;
+    }
+
+    void
+    optimizeBlock(int const b)
+    {
+        CDEEPSO & swarm = *swarms[b];
+        BlockEval eval(*this, b);
+
+        rebase(b);
+
+        for (int g=0;g!=p.blockGens && fitEval<=p.maxFitEval;++g)
+        {
+            const int oldFitEval = swarm.fitEval;
+            swarm.step(eval);
+            fitEval += swarm.fitEval - oldFitEval;
+        }
+
+        if (swarm.gBestFit < gBestFit)
+        {
+            const int first = blockStart[b];
+
+            for (int j=0;j!=blockLen(b);++j)
+            {
+                gBest[first + j] = swarm.gBest[j];
+                scratch[first + j] = swarm.gBest[j];
+
+                if (objective.separable())
+                    gBestTerms[first + j] = objective.term(swarm.gBest[j], first + j);
+            }
+
+            gBestFit = swarm.gBestFit;
+            blockVersion[b] = ++version;
+        }
+    }
+
+    void
+    optimize()
+    {
+        int i;
+
+        initContext();
+        trace.record(fitEval, gBestFit);
+
+        for (i=0;i!=p.maxGen && fitEval<=p.maxFitEval;++i)
+        {
+            for (int b=0;b!=numBlocks() && fitEval<=p.maxFitEval;++b)
+            {
+                optimizeBlock(b);
+                trace.record(fitEval, gBestFit);
+            }
+
+            if (p.printConvergenceResults != 0 && i % p.printConvergenceResults == 0)
+                printn(BLUE, "Cycle: ", i, ", Best Fit: ", std::scientific, gBestFit, std::defaultfloat, ", fitEvals:" , fitEval, "/", p.maxFitEval, "\n", NORMAL);
+        }
+
+        trace.finish(gBestFit);
+        printn(YELLOW, "Optimization has ended, Cycles: ", i, ", Blocks: ", numBlocks(), ", Best Fit: ", std::scientific, gBestFit, std::defaultfloat, ", Fit Evals:" , fitEval, "/", p.maxFitEval, "\n", NORMAL);
+    }
+
+};
+
+#endif // CCDEEPSO_HPP
@@ -1,11 +1,28 @@
 #ifndef CDEEPSO_HPP
 #define CDEEPSO_HPP
 
+#include "anytime.hpp"
 #include "cdeepso_params.hpp"
+#include "constraints.hpp"
+#include "delta.hpp"
+#include "elite.hpp"
+#include "fused.hpp"
+#include "init.hpp"
+#include "local.hpp"
+#include "noise.hpp"
 #include "operations.hpp"
 #include "population.hpp"
+#include "race.hpp"
+#include "shared.hpp"
+#include "trace.hpp"
 #include "weight.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <numeric>
+
 class CDEEPSO
 {
 public:
@@ -23,16 +40,52 @@ public:
     Population memGBest;
     Fitness myBestFitness;
     Fitness memGBestFitness;
+    Violations myBestViolation;
+    Violations memGBestViolation;
 
     Precision gBestFit;
+    Precision gBestViolation;
     vector<Precision> gBest;
 
+    Fitness pop1Fitness;
+    Fitness pop2Fitness;
+    Violations pop1Violation;
+    Violations pop2Violation;
+    Refreshes pop1Refresh;
+    Refreshes pop2Refresh;
+
     int memGBestIndex;
     vector<int> candidates;
     int fitEval;
 
+    int successes;
+    int gensWoChange;
+    uint scheduleSize;
+    int scheduleEval;
+    vector<int> order;
+
+    WeightHistory history;
+    std::unique_ptr<LocalSearch> local;
+
+    ConvergenceTrace trace;
     Random generator;
 
+    RaceBoard * board;
+    bool killable;
+    bool killed;
+
+    SharedArchive * shared;
+    vector<Precision> migrant;
+
+    NoiseRacer noise;
+
+    EliteSet const * warm;
+    uint warmRows;
+
+    AnytimeBest anytime;
+    std::chrono::steady_clock::time_point started;
+    bool timedOut;
+
     typedef std::function<void(int const generation, CDEEPSO&)> LoopListener;
     LoopListener onLoopListener;
 
@@ -46,23 +99,58 @@ public:
         vMin(p.dims),
         vMax(p.dims),
 
-        pop1(p.popSize, p.dims),
-        myBest(p.popSize, p.dims),
-        pop2(p.popSize, p.dims),
-        memGBest(p.popSize, p.dims),
+        pop1(p.popCapacity(), p.dims, p.outOfCore),
+        myBest(p.popCapacity(), p.dims, p.outOfCore),
+        pop2(p.popCapacity(), p.dims, p.outOfCore),
+        memGBest(p.popSize, p.dims, p.outOfCore),
 
-        myBestFitness(p.popSize),
+        myBestFitness(p.popCapacity()),
         memGBestFitness(p.popSize),
+        myBestViolation(p.popCapacity()),
+        memGBestViolation(p.popSize),
 
         gBestFit(-1.0),
+        gBestViolation(0.0),
         gBest(p.dims),
 
+        pop1Fitness(p.popCapacity()),
+        pop2Fitness(p.popCapacity()),
+        pop1Violation(p.popCapacity()),
+        pop2Violation(p.popCapacity()),
+        pop1Refresh(p.popCapacity()),
+        pop2Refresh(p.popCapacity()),
+
         memGBestIndex(0),
-        fitEval(0)
+        fitEval(0),
+        successes(0),
+        gensWoChange(0),
+        scheduleSize(p.popSize),
+        scheduleEval(0),
+
+        history(p.historySize, p.popCapacity()),
+
+        trace(p.tracePoints, p.popSize, p.maxFitEval),
+        generator(p.seed),
+
+        board(nullptr),
+        killable(false),
+        killed(false),
 
+        shared(nullptr),
+        migrant(p.dims),
+
+        noise(p),
+
+        warm(nullptr),
+        warmRows(0),
+
+        anytime(p.dims),
+        timedOut(false)
     {
-        ops::initLimits(p.dims, p.xMin, p.xMax, xMin, xMax, vMin, vMax);
-        candidates.reserve(p.popSize + p.memGBestSize);
+        ops::initLimits(p, xMin, xMax, vMin, vMax);
+        candidates.reserve(p.popCapacity() + p.memGBestSize);
+        order.reserve(p.popCapacity());
+        resizePopulation(p.popSize);
     }
 
     void
@@ -71,59 +159,265 @@ public:
         this->onLoopListener = onLoopListener;
     }
 
+    // Joins a race, killable runs may be aborted when they fall behind
+    void
+    setRaceBoard(RaceBoard * board,
+                 bool const killable)
+    {
+        this->board = board;
+        this->killable = killable;
+    }
+
+    void
+    setSharedArchive(SharedArchive * shared)
+    {
+        this->shared = shared;
+    }
+
+    // The next start() seeds up to eliteFraction of pop1, and the memory,
+    // with the best entries of elite
+    void
+    setWarmStart(EliteSet const * elite)
+    {
+        warm = elite;
+    }
+
+    // Best n distinct solutions among the personal bests and the memory
+    EliteSet
+    elite(uint const n) const
+    {
+        EliteSet result(p.dims);
+
+        for (uint i=0;i!=myBest.size();++i)
+            result.add(&myBest.particles(i,0), myBest.weights[i], myBestFitness[i], myBestViolation[i]);
+
+        for (int i=0;i!=memGBestIndex;++i)
+            result.add(&memGBest.particles(i,0), memGBest.weights[i], memGBestFitness[i], memGBestViolation[i]);
+
+        result.keepBest(n);
+        return result;
+    }
+
+    void
+    publishGBest()
+    {
+        anytime.publish(gBest, gBestFit, gBestViolation, fitEval);
+
+        if (board && gBestViolation == 0.0)
+            board->publish(gBestFit);
+    }
+
+    double
+    elapsedMillis() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    }
+
+    // True when p.deadline is off or n more evaluations still fit in the time
+    // left. The cost of an evaluation is the wall time of the run so far over
+    // its fitEvals, so it includes the work of the optimizer between batches.
+    bool
+    fitsDeadline(int const n) const
+    {
+        if (p.deadline <= 0.0)
+            return true;
+
+        const double elapsed = elapsedMillis();
+        return elapsed + n * elapsed / std::max(fitEval, 1) < p.deadline;
+    }
+
+    bool
+    raceOver()
+    {
+        if (!board)
+            return false;
+
+        if (board->isFinished())
+            return true;
+
+        if (killable && board->isHopeless(fitEval, gBestFit))
+        {
+            killed = true;
+            board->kills.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        return false;
+    }
+
     void
     initPopulationInPop1()
     {
         ops::initPopulation(pop1, generator, xMin, xMax, vMin, vMax, p.maxVelocity);
+        ops::initPositions(pop1, p.initStrategy, generator, xMin, xMax);
+        seedFromElite();
+        ops::enforceLimits(pop1, nullptr, xMin, xMax, vMin, vMax, p.intDims, p.boundStrategy, generator);
+    }
+
+    // The first rows of pop1 take the positions and weights of the warm
+    // start, the others keep their random particles. The random numbers drawn
+    // are the same as in a cold start.
+    void
+    seedFromElite()
+    {
+        warmRows = 0;
+
+        if (!warm)
+            return;
+
+        if (warm->dims != p.dims)
+            error("Elite set has", warm->dims, "dims, expected", p.dims);
+
+        warmRows = std::min(uint(warm->entries.size()), uint(p.eliteFraction * pop1.size()));
+
+        for (uint k=0;k!=warmRows;++k)
+        {
+            EliteSet::Entry const & e = warm->entries[k];
+            Random * const g = pop1.weights[k].generator;
+
+            std::copy(e.x.begin(), e.x.end(), &pop1.particles(k,0));
+            pop1.weights[k] = e.weight;
+            pop1.weights[k].generator = g;
+        }
+    }
+
+    // The evaluated warm rows also fill the memory
+    void
+    seedMemory()
+    {
+        if (warmRows == 0)
+            return;
+
+        memGBestIndex = std::min(warmRows, memGBest.size());
+
+        for (int k=0;k!=memGBestIndex;++k)
+        {
+            memGBest.particles.importRow(pop1.particles, k, k);
+            memGBest.velocity.importRow(pop1.velocity, k, k);
+            memGBest.weights[k] = pop1.weights[k];
+            memGBestFitness[k] = pop1Fitness[k];
+            memGBestViolation[k] = pop1Violation[k];
+        }
     }
 
     void
     initBestsFromPop1(Fitness & pop1Fitness)
     {
-        ops::initBests(pop1, pop1Fitness, myBest, myBestFitness, gBest, gBestFit);
+        ops::initBests(pop1, pop1Fitness, pop1Violation, myBest, myBestFitness, myBestViolation, gBest, gBestFit, gBestViolation);
+        noise.reset();
+        publishGBest();
+    }
+
+    ops::RowLimits
+    rowLimits()
+    {
+        return ops::RowLimits(xMin, xMax, vMin, vMax, p.intDims, p.boundStrategy, generator);
     }
 
     void
     createPop2FromHeuristic(Fitness & pop1Fitness,
                             Refreshes & pop2Refresh)
     {
+        const ops::RowLimits limits = rowLimits();
+        ops::RowLimits const * const fusedLimits = p.fused ? &limits : nullptr;
+
         if (p.deType == CDEEPSOParams::DEType::RAND)
-            ops::heuristicRand(pop1, pop1Fitness, pop2, myBest, memGBest, memGBestFitness, memGBestIndex, p.memStrategy, candidates, pop2Refresh, generator);
+            ops::heuristicRand(pop1, pop1Fitness, pop1Violation, pop2, myBest, memGBest, memGBestFitness, memGBestViolation, memGBestIndex, p.memStrategy, candidates, pop2Refresh, generator, fusedLimits);
 
         else if (p.deType == CDEEPSOParams::DEType::BEST)
-            ops::heuristicBest(pop1, pop1Fitness, pop2, gBest, memGBest, memGBestFitness, memGBestIndex, p.memStrategy, candidates, pop2Refresh, generator);
+            ops::heuristicBest(pop1, pop1Fitness, pop1Violation, pop2, gBest, memGBest, memGBestFitness, memGBestViolation, memGBestIndex, p.memStrategy, candidates, pop2Refresh, generator, fusedLimits);
 
         else
             error("Unknown deType");
 
-        ops::enforceLimits(pop2, xMin, xMax, vMin, vMax);
+        if (!p.fused)
+            ops::enforceLimits(pop2, &pop1, xMin, xMax, vMin, vMax, p.intDims, p.boundStrategy, generator);
     }
 
     void
     createPop2FromMutatedWeight()
     {
-        pop2.cloneFrom(pop1);
-        ops::computeNewWeights(pop1, pop2, p.mutationRate, p.maxVelocity);
+        if (p.fused)
+            pop2.cloneWeightsFrom(pop1);
+        else
+            pop2.cloneFrom(pop1);
+
+        if (p.weightAdaptation == CDEEPSOParams::WeightAdaptation::HISTORY)
+            ops::computeNewWeights(pop2, history, generator, p.historyScale, p.maxVelocity);
+        else
+            ops::computeNewWeights(pop1, pop2, p.mutationRate, p.maxVelocity);
+
+        if (p.fused)
+        {
+            ops::moveFused(pop1, pop2, generator, myBest, gBest, vMin, vMax, p.communicationProbability, rowLimits());
+            return;
+        }
+
         ops::computeNewVel(pop2, generator, myBest, gBest, vMin, vMax, p.communicationProbability);
         ops::computeNewPos(pop2);
-        ops::enforceLimits(pop2, xMin, xMax, vMin, vMax);
+        ops::enforceLimits(pop2, &pop1, xMin, xMax, vMin, vMax, p.intDims, p.boundStrategy, generator);
     }
 
     void
     createPop1FromVelocity()
     {
+        if (p.fused)
+        {
+            ops::moveFused(pop1, pop1, generator, myBest, gBest, vMin, vMax, p.communicationProbability, rowLimits());
+            return;
+        }
+
         ops::computeNewVel(pop1, generator, myBest, gBest, vMin, vMax, p.communicationProbability);
         ops::computeNewPos(pop1);
-        ops::enforceLimits(pop1, xMin, xMax, vMin, vMax);
+        ops::enforceLimits(pop1, nullptr, xMin, xMax, vMin, vMax, p.intDims, p.boundStrategy, generator);
     }
 
+    // With weightsMutated, the weights of pop2 came from createPop2FromMutatedWeight
+    // and the winners feed the weight history. With noise handling, the
+    // contested comparisons against the personal bests and gBest are raced
+    // with eval first.
+    template <typename EVAL>
     void
     mergeIntoPop1(Fitness & pop1Fitness,
-                  Fitness & pop2Fitness)
+                  Fitness & pop2Fitness,
+                  EVAL & eval,
+                  bool const weightsMutated=false)
+    {
+        const bool adaptive = weightsMutated && p.weightAdaptation == CDEEPSOParams::WeightAdaptation::HISTORY;
+
+        const bool fused = p.fused && !noise.enabled();
+
+        if (fused)
+            successes += ops::mergeFused(pop2, pop1, pop2Fitness, pop2Violation, pop1Fitness, pop1Violation,
+                                         myBest, myBestFitness, myBestViolation, adaptive ? &history : nullptr, p.maxVelocity);
+        else
+            ops::mergePopulations(pop2, pop1, pop2Fitness, pop2Violation, pop1Fitness, pop1Violation,
+                                  adaptive ? &history : nullptr, p.maxVelocity);
+
+        if (adaptive)
+            history.update();
+
+        if (noise.enabled())
+        {
+            noise.keepWinners(pop2Fitness, pop2Violation, pop1Fitness, pop1Violation);
+            fitEval += noise.raceMyBests(eval, pop1, pop1Fitness, pop1Violation, myBest, myBestFitness, myBestViolation);
+        }
+
+        if (!fused)
+            successes += ops::updateMyBestPos(pop1, pop1Fitness, pop1Violation, myBest, myBestFitness, myBestViolation);
+
+        raceGBest(eval);
+        ops::updateGBest(pop1, pop1Fitness, pop1Violation, memGBest, memGBestFitness, memGBestViolation, memGBestIndex, gBest, gBestFit, gBestViolation);
+        publishGBest();
+    }
+
+    template <typename EVAL>
+    void
+    raceGBest(EVAL & eval)
     {
-        ops::mergePopulations(pop2, pop1, pop2Fitness, pop1Fitness);
-        ops::updateMyBestPos(pop1, pop1Fitness, myBest, myBestFitness);
-        ops::updateGBest(pop1, pop1Fitness, memGBest, memGBestFitness, memGBestIndex, gBest, gBestFit);
+        if (noise.enabled())
+            fitEval += noise.raceGBest(eval, pop1, pop1Fitness, pop1Violation, gBest, gBestFit, gBestViolation,
+                                       memGBestFitness, memGBestViolation, memGBestIndex);
     }
 
     template <typename EVAL>
@@ -131,13 +425,32 @@ public:
     computeFitness(Population & pop,
                    Refreshes & refresh,
                    Fitness & fitness,
-                   EVAL eval)
+                   Violations & violation,
+                   EVAL & eval)
     {
-        eval(pop.particles, refresh, fitness);
+        evaluate(eval, pop.particles, refresh, fitness, violation);
+        countFitnessEvals(refresh);
+    }
 
-//        const int oldFitEval = fitEval;
+    // Same as computeFitness, but lets incremental evaluators start from the
+    // cached terms of the matching rows in reference
+    template <typename EVAL>
+    void
+    computeFitnessNear(Population & pop,
+                       Refreshes & refresh,
+                       Fitness & fitness,
+                       Violations & violation,
+                       EVAL & eval,
+                       Population const & reference)
+    {
+        evaluateNear(eval, pop.particles, refresh, fitness, violation, reference.particles);
+        countFitnessEvals(refresh);
+    }
 
-        for (uint i=0;i!=pop.size();++i)
+    void
+    countFitnessEvals(Refreshes & refresh)
+    {
+        for (uint i=0;i!=refresh.size();++i)
         {
             if (refresh[i])
             {
@@ -145,62 +458,423 @@ public:
                 refresh[i] = false;
             }
         }
-
-//        print("Added evals:", fitEval - oldFitEval);
     }
 
+    // Rows past the active population are never refreshed
     void
     clearRefresh(Refreshes & refresh,
                  bool const value)
     {
         for (size_t i=0;i!=refresh.size();++i)
-            refresh[i] = value;
+            refresh[i] = value && i < pop1.size();
+    }
+
+    // The containers only change their active size, the capacity reserved in
+    // the constructor is kept
+    void
+    resizePopulation(uint const n)
+    {
+        pop1.resize(n);
+        pop2.resize(n);
+        myBest.resize(n);
+
+        pop1Fitness.resize(n);
+        pop2Fitness.resize(n);
+        pop1Violation.resize(n);
+        pop2Violation.resize(n);
+        myBestFitness.resize(n);
+        myBestViolation.resize(n);
+    }
+
+    // Keeps the n particles with the best personal bests, in their order
+    void
+    shrinkPopulation(uint const n)
+    {
+        order.resize(pop1.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::nth_element(order.begin(), order.begin() + n, order.end(), [&](int a, int b) {
+            return ops::isBetter(myBestFitness[a], myBestViolation[a], myBestFitness[b], myBestViolation[b]);
+        });
+        std::sort(order.begin(), order.begin() + n);
+
+        for (uint k=0;k!=n;++k)
+        {
+            const int i = order[k];
+            pop1.moveRow(i, k);
+            myBest.moveRow(i, k);
+            noise.moveBest(i, k);
+            pop1Fitness[k] = pop1Fitness[i];
+            pop1Violation[k] = pop1Violation[i];
+            myBestFitness[k] = myBestFitness[i];
+            myBestViolation[k] = myBestViolation[i];
+        }
+
+        resizePopulation(n);
     }
 
+    // Adds random particles up to n and evaluates them
     template <typename EVAL>
     void
-    optimize(EVAL eval, bool initPop=true)
+    growPopulation(uint const n,
+                   EVAL & eval)
     {
-        Fitness pop1Fitness(pop1.size());
-        Fitness pop2Fitness(pop2.size());
+        const uint first = pop1.size();
+        resizePopulation(n);
 
-        Refreshes pop1Refresh(pop1.size());
-        Refreshes pop2Refresh(pop2.size());
+        ops::initPopulation(pop1, generator, xMin, xMax, vMin, vMax, p.maxVelocity, first);
+        ops::initPositions(pop1, p.initStrategy, generator, xMin, xMax, first);
+        ops::enforceLimits(pop1, nullptr, xMin, xMax, vMin, vMax, p.intDims, p.boundStrategy, generator);
 
-        int i;
+        clearRefresh(pop1Refresh, false);
+        for (uint i=first;i!=n;++i)
+            pop1Refresh[i] = true;
+        computeFitness(pop1, pop1Refresh, pop1Fitness, pop1Violation, eval);
+
+        for (uint i=first;i!=n;++i)
+        {
+            myBest.particles.importRow(pop1.particles, i, i);
+            myBest.velocity.importRow(pop1.velocity, i, i);
+            myBest.weights[i] = pop1.weights[i];
+            myBestFitness[i] = pop1Fitness[i];
+            myBestViolation[i] = pop1Violation[i];
+        }
+
+        noise.fresh(first, n);
+        raceGBest(eval);
+        ops::updateGBest(pop1, pop1Fitness, pop1Violation, memGBest, memGBestFitness, memGBestViolation, memGBestIndex, gBest, gBestFit, gBestViolation);
+        publishGBest();
+    }
+
+    // LINEAR shrinks along a line from popSize at the start to minPopSize at
+    // maxFitEval (L-SHADE), the line starts again from the grown size after a
+    // growth. SUCCESS drops the worst particle after every
+    // generation in which less than popSuccess of the particles improved
+    // their personal best. Both grow by half after maxGenWoChangeBest
+    // generations without a better gBest, up to maxPopSize.
+    template <typename EVAL>
+    void
+    adaptPopulation(EVAL & eval,
+                    bool const improved)
+    {
+        const uint n = pop1.size();
+        const uint minSize = std::max(p.minPopSize, 4);
+        const int generationSuccesses = successes;
+
+        successes = 0;
+        gensWoChange = improved ? 0 : gensWoChange + 1;
+
+        if (p.popSizing == CDEEPSOParams::PopSizing::FIXED)
+            return;
+
+        if (gensWoChange >= p.maxGenWoChangeBest && n < pop1.capacity())
+        {
+            gensWoChange = 0;
+            growPopulation(std::min(pop1.capacity(), n + std::max(1u, n / 2)), eval);
+            scheduleSize = pop1.size();
+            scheduleEval = fitEval;
+            return;
+        }
+
+        uint target = n;
+
+        if (p.popSizing == CDEEPSOParams::PopSizing::LINEAR)
+            target = uint(std::round(scheduleSize + (double(minSize) - scheduleSize) * (fitEval - scheduleEval) / std::max(p.maxFitEval - scheduleEval, 1)));
+
+        else if (generationSuccesses < p.popSuccess * 2 * n)
+            target = n - 1;
+
+        target = std::max(target, minSize);
+
+        if (target < n)
+            shrinkPopulation(target);
+    }
+
+    template <typename EVAL>
+    void
+    start(EVAL & eval, bool initPop=true)
+    {
+        started = std::chrono::steady_clock::now();
+        timedOut = false;
+        anytime.reset();
 
         if (initPop)
             initPopulationInPop1();
 
         clearRefresh(pop1Refresh, true);
-        computeFitness(pop1, pop1Refresh, pop1Fitness, eval);
+        computeFitness(pop1, pop1Refresh, pop1Fitness, pop1Violation, eval);
+
+        if (initPop && p.opposition)
+            keepOpposites(eval);
+
         initBestsFromPop1(pop1Fitness);
 
-        for (i=0;i!=p.maxGen && fitEval<=p.maxFitEval;++i)
+        if (initPop)
+            seedMemory();
+    }
+
+    // Opposition-based initialization: evaluates the mirror of every initial
+    // particle and keeps the better of each pair
+    template <typename EVAL>
+    void
+    keepOpposites(EVAL & eval)
+    {
+        ops::oppositePositions(pop1, pop2, xMin, xMax);
+        ops::enforceLimits(pop2, nullptr, xMin, xMax, vMin, vMax, p.intDims, p.boundStrategy, generator);
+
+        clearRefresh(pop2Refresh, true);
+        computeFitness(pop2, pop2Refresh, pop2Fitness, pop2Violation, eval);
+
+        for (uint i=0;i!=pop1.size();++i)
+        {
+            if (ops::isBetter(pop2Fitness[i], pop2Violation[i], pop1Fitness[i], pop1Violation[i]))
+            {
+                pop1.particles.importRow(pop2.particles, i, i);
+                pop1Fitness[i] = pop2Fitness[i];
+                pop1Violation[i] = pop2Violation[i];
+            }
+        }
+    }
+
+    template <typename EVAL>
+    void
+    step(EVAL & eval)
+    {
+        pop2Fitness = pop1Fitness;
+        pop2Violation = pop1Violation;
+        clearRefresh(pop2Refresh, false);
+        createPop2FromHeuristic(pop1Fitness, pop2Refresh);
+
+        if (p.deType == CDEEPSOParams::DEType::RAND)
+            computeFitnessNear(pop2, pop2Refresh, pop2Fitness, pop2Violation, eval, myBest);
+        else
+            computeFitness(pop2, pop2Refresh, pop2Fitness, pop2Violation, eval);
+
+        mergeIntoPop1(pop1Fitness, pop2Fitness, eval);
+
+        // The rest evaluates pop2 and pop1 before the next merge, so it is
+        // skipped as a whole when both would not end before the deadline
+        if (!fitsDeadline(2 * pop1.size()))
+        {
+            timedOut = true;
+            return;
+        }
+
+        createPop2FromMutatedWeight();
+        clearRefresh(pop2Refresh, true);
+
+        if (p.pipeline)
         {
-            pop2Fitness = pop1Fitness;
-            clearRefresh(pop2Refresh, false);
-            createPop2FromHeuristic(pop1Fitness, pop2Refresh);
-            computeFitness(pop2, pop2Refresh, pop2Fitness, eval);
-            mergeIntoPop1(pop1Fitness, pop2Fitness);
+            // pop2 is evaluated by another thread while pop1 moves. Both read
+            // the same merged state, pop2 was fully built first and the
+            // evaluation draws no random numbers, so the generator sequence and
+            // the result are the same as in the sequential branch. Only one
+            // evaluation is in flight at a time.
+            auto pending = std::async(std::launch::async, [&]() {
+                evaluate(eval, pop2.particles, pop2Refresh, pop2Fitness, pop2Violation);
+            });
+
+            createPop1FromVelocity();
+            clearRefresh(pop1Refresh, true);
 
-            createPop2FromMutatedWeight();
-            clearRefresh(pop2Refresh, true);
-            computeFitness(pop2, pop2Refresh, pop2Fitness, eval);
+            pending.get();
+            countFitnessEvals(pop2Refresh);
+        }
+        else
+        {
+            computeFitness(pop2, pop2Refresh, pop2Fitness, pop2Violation, eval);
 
             createPop1FromVelocity();
             clearRefresh(pop1Refresh, true);
-            computeFitness(pop1, pop1Refresh, pop1Fitness, eval);
+        }
+
+        computeFitness(pop1, pop1Refresh, pop1Fitness, pop1Violation, eval);
+
+        mergeIntoPop1(pop1Fitness, pop2Fitness, eval, true);
+
+        // pop2 is rebuilt from scratch by the next step
+        pop2.release();
+    }
+
+    // Memetic stage: refines a feasible gBest with the local optimizer. An
+    // improved point enters memGBest like any new gBest.
+    template <typename EVAL>
+    void
+    refineGBest(EVAL & eval)
+    {
+        const int budget = std::min(p.localBudget, p.maxFitEval - fitEval);
+
+        if (budget <= 0 || gBestViolation != 0.0)
+            return;
+
+        if (!local)
+            local.reset(new LocalSearch(p, xMin, xMax));
 
-            mergeIntoPop1(pop1Fitness, pop2Fitness);
+        const long oldEvals = local->evals;
+        vector<Precision> x = gBest;
+        Precision f = gBestFit;
+        Precision viol = gBestViolation;
+
+        const bool improved = local->refine(eval, x, f, viol, budget) &&
+                ops::isBetter(f, viol, gBestFit, gBestViolation);
+
+        fitEval += local->evals - oldEvals;
+
+        if (improved)
+            insertIntoMemory(x.data(), f, viol);
+    }
+
+    // Adds a solution found outside the swarm to memGBest, replacing the worst
+    // entry once the memory is full. It also becomes gBest when better.
+    void
+    insertIntoMemory(Precision const * const x,
+                     Precision const f,
+                     Precision const viol)
+    {
+        const bool full = memGBestIndex == int(memGBest.size());
+        const int dstId = full ? ops::indexOfWorst(memGBestFitness, memGBestViolation) : memGBestIndex;
+
+        if (full && !ops::isBetter(f, viol, memGBestFitness[dstId], memGBestViolation[dstId]))
+            return;
+
+        if (!full)
+            ++memGBestIndex;
+
+        std::copy(x, x + p.dims, &memGBest.particles(dstId,0));
+        std::fill(&memGBest.velocity(dstId,0), &memGBest.velocity(dstId,0) + p.dims, 0.0);
+        memGBest.weights[dstId] = pop1.weights[ops::indexOfBest(pop1Fitness, pop1Violation)];
+        memGBestFitness[dstId] = f;
+        memGBestViolation[dstId] = viol;
+
+        const bool better = ops::isBetter(f, viol, gBestFit, gBestViolation);
+        noise.insertedIntoMemory(dstId, better);
+
+        if (better)
+        {
+            std::copy(x, x + p.dims, gBest.begin());
+            gBestFit = f;
+            gBestViolation = viol;
+            publishGBest();
+        }
+    }
+
+    // Publishes gBest to the shared archive and migrates a random solution of
+    // the archive, possibly from another process, into memGBest
+    void
+    exchangeShared()
+    {
+        if (gBestViolation == 0.0)
+            shared->publish(gBest.data(), gBestFit);
+
+        Precision f;
+
+        if (shared->sample(generator, migrant.data(), f))
+            insertIntoMemory(migrant.data(), f, 0.0);
+    }
+
+    // Adds delta to every stored fitness. Used when the objective changed by a
+    // known constant for all particles, e.g., the context of a separable block.
+    void
+    shiftFitness(Precision const delta)
+    {
+        for (uint i=0;i!=pop1.size();++i)
+        {
+            pop1Fitness[i] += delta;
+            myBestFitness[i] += delta;
+        }
+
+        for (int i=0;i!=memGBestIndex;++i)
+            memGBestFitness[i] += delta;
+
+        gBestFit += delta;
+        anytime.publish(gBest, gBestFit, gBestViolation, fitEval);
+    }
+
+    // Evaluates pop1, myBest and the memory again, for objectives that changed
+    // in an unknown way. gBest is then taken from the refreshed bests.
+    template <typename EVAL>
+    void
+    reevaluate(EVAL & eval)
+    {
+        clearRefresh(pop1Refresh, true);
+        computeFitness(pop1, pop1Refresh, pop1Fitness, pop1Violation, eval);
+
+        clearRefresh(pop2Refresh, true);
+        computeFitness(myBest, pop2Refresh, myBestFitness, myBestViolation, eval);
+
+        clearRefresh(pop2Refresh, false);
+        for (int i=0;i!=memGBestIndex;++i)
+            pop2Refresh[i] = true;
+        computeFitness(memGBest, pop2Refresh, memGBestFitness, memGBestViolation, eval);
+
+        const int srcId = ops::indexOfBest(myBestFitness, myBestViolation);
+        myBest.particles.exportRow(srcId, gBest);
+        gBestFit = myBestFitness[srcId];
+        gBestViolation = myBestViolation[srcId];
+
+        for (int i=0;i!=memGBestIndex;++i)
+        {
+            if (ops::isBetter(memGBestFitness[i], memGBestViolation[i], gBestFit, gBestViolation))
+            {
+                memGBest.particles.exportRow(i, gBest);
+                gBestFit = memGBestFitness[i];
+                gBestViolation = memGBestViolation[i];
+            }
+        }
+
+        noise.reset();
+        anytime.publish(gBest, gBestFit, gBestViolation, fitEval);
+    }
+
+    template <typename EVAL>
+    void
+    optimize(EVAL eval, bool initPop=true)
+    {
+        int i;
+
+        start(eval, initPop);
+        trace.record(fitEval, gBestFit);
+
+        for (i=0;i!=p.maxGen && fitEval<=p.maxFitEval;++i)
+        {
+            const Precision oldBest = gBestFit;
+            const Precision oldViolation = gBestViolation;
+
+            if (!fitsDeadline(pop1.size()))
+                timedOut = true;
+            else
+                step(eval);
+
+            if (timedOut)
+                break;
+
+            adaptPopulation(eval, ops::isBetter(gBestFit, gBestViolation, oldBest, oldViolation));
+
+            if (p.localSearch != CDEEPSOParams::LocalSearch::NONE && p.localEvery > 0 && (i + 1) % p.localEvery == 0 && fitsDeadline(p.localBudget))
+                refineGBest(eval);
+
+            if (shared && p.sharedEvery > 0 && (i + 1) % p.sharedEvery == 0)
+                exchangeShared();
+
+            trace.record(fitEval, gBestFit);
 
             if (p.printConvergenceResults != 0 && i % p.printConvergenceResults == 0)
                 printn(BLUE, "Gen: ", i, ", Best Fit: ", std::scientific, gBestFit, std::defaultfloat, ", fitEvals:" , fitEval, "/", p.maxFitEval, "\n", NORMAL);
 
             if (onLoopListener)
                 onLoopListener(i, *this);
+
+            if (raceOver())
+                break;
         }
 
+        trace.finish(gBestFit);
+
+        if (timedOut)
+            printn(YELLOW, "Deadline of ", p.deadline, " ms reached after ", elapsedMillis(), " ms\n", NORMAL);
+
+        if (noise.enabled())
+            printn(YELLOW, "Noise: ", noise.resamples, " resampled evaluations (", std::defaultfloat, 100.0 * noise.resamples / std::max(fitEval, 1), "% of fitEvals) in ", noise.contests, " contested comparisons\n", NORMAL);
+
         printn(YELLOW, "Optimization has ended, Generations: ", i, ", Best Fit: ", std::scientific, gBestFit, std::defaultfloat, ", Fit Evals:" , fitEval, "/", p.maxFitEval, "\n", NORMAL);
 
     }
@@ -210,13 +884,13 @@ public:
     void
     showPop1()
     {
-        showPopulation(pop1, p.popSize, "POP1");
+        showPopulation(pop1, pop1.size(), "POP1");
     }
 
     void
     showPop2()
     {
-        showPopulation(pop2, p.popSize, "POP2");
+        showPopulation(pop2, pop2.size(), "POP2");
     }
 
     void
@@ -228,7 +902,7 @@ public:
     void
     showMyBest()
     {
-        showPopulation(myBest, p.popSize, "MY_BEST");
+        showPopulation(myBest, myBest.size(), "MY_BEST");
     }
 
     void
@@ -1,12 +1,15 @@
 #ifndef CDEEPSO_PARAMS_HPP
 #define CDEEPSO_PARAMS_HPP
 
+#include "rng.hpp"
+
 #include <wup/wup.hpp>
+#include <cmath>
+#include <fstream>
 
 using namespace wup;
 
 typedef double Precision;
-typedef wup::base_random<NaiveGenerator<Precision>, Precision> Random;
 
 class CDEEPSOParams
 {
@@ -23,6 +26,38 @@ public:
         BEST=3
     };
 
+    enum PopSizing {
+        FIXED=1,
+        LINEAR=2,
+        SUCCESS=3
+    };
+
+    enum WeightAdaptation {
+        NOISE=1,
+        HISTORY=2
+    };
+
+    enum InitStrategy {
+        UNIFORM=1,
+        LHS=2,
+        HALTON=3,
+        SOBOL=4
+    };
+
+    enum LocalSearch {
+        NONE=1,
+        COORDINATE=2,
+        LBFGS=3
+    };
+
+    enum BoundStrategy {
+        CLAMP=1,
+        REFLECT=2,
+        WRAP=3,
+        REINIT=4,
+        MIDPOINT=5
+    };
+
 private:
 
     class MemStrategyDecoder : public std::map<std::string, MemStrategy>
@@ -46,30 +81,144 @@ private:
         }
     };
 
+    class PopSizingDecoder : public std::map<std::string, PopSizing>
+    {
+    public:
+        PopSizingDecoder()
+        {
+            (*this)["FIXED"] = PopSizing::FIXED;
+            (*this)["LINEAR"] = PopSizing::LINEAR;
+            (*this)["SUCCESS"] = PopSizing::SUCCESS;
+        }
+    };
+
+    class WeightAdaptationDecoder : public std::map<std::string, WeightAdaptation>
+    {
+    public:
+        WeightAdaptationDecoder()
+        {
+            (*this)["NOISE"] = WeightAdaptation::NOISE;
+            (*this)["HISTORY"] = WeightAdaptation::HISTORY;
+        }
+    };
+
+    class InitStrategyDecoder : public std::map<std::string, InitStrategy>
+    {
+    public:
+        InitStrategyDecoder()
+        {
+            (*this)["UNIFORM"] = InitStrategy::UNIFORM;
+            (*this)["LHS"] = InitStrategy::LHS;
+            (*this)["HALTON"] = InitStrategy::HALTON;
+            (*this)["SOBOL"] = InitStrategy::SOBOL;
+        }
+    };
+
+    class LocalSearchDecoder : public std::map<std::string, LocalSearch>
+    {
+    public:
+        LocalSearchDecoder()
+        {
+            (*this)["NONE"] = LocalSearch::NONE;
+            (*this)["COORDINATE"] = LocalSearch::COORDINATE;
+            (*this)["LBFGS"] = LocalSearch::LBFGS;
+        }
+    };
+
+    class BoundStrategyDecoder : public std::map<std::string, BoundStrategy>
+    {
+    public:
+        BoundStrategyDecoder()
+        {
+            (*this)["CLAMP"] = BoundStrategy::CLAMP;
+            (*this)["REFLECT"] = BoundStrategy::REFLECT;
+            (*this)["WRAP"] = BoundStrategy::WRAP;
+            (*this)["REINIT"] = BoundStrategy::REINIT;
+            (*this)["MIDPOINT"] = BoundStrategy::MIDPOINT;
+        }
+    };
+
 public:
 
     MemStrategy memStrategy = MemStrategy::MEM;
     DEType deType = DEType::BEST;
+    BoundStrategy boundStrategy = BoundStrategy::CLAMP;
+    PopSizing popSizing = PopSizing::FIXED;
+    WeightAdaptation weightAdaptation = WeightAdaptation::NOISE;
+    InitStrategy initStrategy = InitStrategy::UNIFORM;
+    LocalSearch localSearch = LocalSearch::NONE;
 
     Precision mutationRate = 0.5;
     Precision communicationProbability = 0.1;
     Precision maxVelocity = 2.0;
     Precision xMin = -1.0;
     Precision xMax = 1.0;
+    Precision hvRef = 1.1;
+    Precision popSuccess = 0.1;
+    Precision historyScale = 0.3;
+    Precision raceTarget = 1e-8;
+    Precision raceCheck = 0.25;
+    Precision raceRatio = 10.0;
+    Precision deadline = 0.0;
+    Precision noiseZ = 2.0;
+    Precision noiseSigma = 0.0;
+    Precision eliteFraction = 0.5;
 
-//    int blockSize = 10;
+    int blockSize = 0;
+    int blockGens = 1;
     int dims = 50;
     int popSize = 50;
+    int minPopSize = 4;
+    int maxPopSize = 0;
     int memGBestSize = 5;
+    int historySize = 10;
+    int archiveSize = 100;
     int maxFitEval = 100000;
     int maxGen = 50000;
     int maxGenWoChangeBest = 1000;
     int printConvergenceResults = 100;
     int maxRun = 50;
     int threads = 0;
-    int ntupleDims = 8;
+    int seed = 0;
+    int experimentSeeds = 10;
+    int deltaEval = 0;
+    int opposition = 0;
+    int pipeline = 0;
+    int noiseSamples = 0;
+    int fused = 0;
+    int trafficBench = 0;
+    int eliteSize = 10;
+    int suiteSeed = 1;
+    int localEvery = 100;
+    int localBudget = 1000;
+    int sharedTop = 64;
+    int sharedCache = 65536;
+    int sharedEvery = 50;
+    int numa = 0;
+    int planner = 0;
+    int tracePoints = 32;
+    int race = 0;
+    int raceRestarts = 2;
 
     std::string eval = "ras";
+    std::string boundsFile = "";
+    std::string constraint = "none";
+    std::string experiment = "";
+    std::string experimentEvals = "ras,ros,gri";
+    std::string traceFile = "";
+    std::string sharedFile = "";
+    std::string batch = "";
+    std::string batchOut = "batch.csv";
+    std::string shiftFile = "";
+    std::string rotationFile = "";
+    std::string outOfCore = "";
+    std::string loadElite = "";
+    std::string saveElite = "";
+
+    // Per dimension bounds and integer dimensions, loaded from boundsFile
+    std::vector<Precision> dimMin;
+    std::vector<Precision> dimMax;
+    std::vector<int> intDims;
 
 public:
 
@@ -89,26 +238,135 @@ public:
     {
         p.popEnum<MemStrategyDecoder>("memStrategy", memStrategy);
         p.popEnum<DETypeDecoder>("deType", deType);
+        p.popEnum<BoundStrategyDecoder>("boundStrategy", boundStrategy);
+        p.popEnum<PopSizingDecoder>("popSizing", popSizing);
+        p.popEnum<WeightAdaptationDecoder>("weightAdaptation", weightAdaptation);
+        p.popEnum<InitStrategyDecoder>("initStrategy", initStrategy);
+        p.popEnum<LocalSearchDecoder>("localSearch", localSearch);
 
         p.popDouble("mutationRate", mutationRate);
         p.popDouble("communicationProbability", communicationProbability);
         p.popDouble("maxVelocity", maxVelocity);
         p.popDouble("xMin", xMin);
         p.popDouble("xMax", xMax);
+        p.popDouble("hvRef", hvRef);
+        p.popDouble("popSuccess", popSuccess);
+        p.popDouble("historyScale", historyScale);
+        p.popDouble("raceTarget", raceTarget);
+        p.popDouble("raceCheck", raceCheck);
+        p.popDouble("raceRatio", raceRatio);
+        p.popDouble("deadline", deadline);
+        p.popDouble("noiseZ", noiseZ);
+        p.popDouble("noiseSigma", noiseSigma);
+        p.popDouble("eliteFraction", eliteFraction);
 
-//        p.popInt("blockSize", blockSize);
+        p.popInt("blockSize", blockSize);
+        p.popInt("blockGens", blockGens);
         p.popInt("dims", dims);
         p.popInt("popSize", popSize);
+        p.popInt("minPopSize", minPopSize);
+        p.popInt("maxPopSize", maxPopSize);
         p.popInt("memGBestSize", memGBestSize);
+        p.popInt("historySize", historySize);
+        p.popInt("archiveSize", archiveSize);
         p.popInt("maxFitEval", maxFitEval);
         p.popInt("maxGen", maxGen);
         p.popInt("maxGenWoChangeBest", maxGenWoChangeBest);
         p.popInt("printConvergenceResults", printConvergenceResults);
         p.popInt("maxRun", maxRun);
         p.popInt("threads", threads);
-        p.popInt("ntupleDims", ntupleDims);
+        p.popInt("seed", seed);
+        p.popInt("experimentSeeds", experimentSeeds);
+        p.popInt("deltaEval", deltaEval);
+        p.popInt("opposition", opposition);
+        p.popInt("pipeline", pipeline);
+        p.popInt("noiseSamples", noiseSamples);
+        p.popInt("fused", fused);
+        p.popInt("trafficBench", trafficBench);
+        p.popInt("eliteSize", eliteSize);
+        p.popInt("suiteSeed", suiteSeed);
+        p.popInt("localEvery", localEvery);
+        p.popInt("localBudget", localBudget);
+        p.popInt("sharedTop", sharedTop);
+        p.popInt("sharedCache", sharedCache);
+        p.popInt("sharedEvery", sharedEvery);
+        p.popInt("numa", numa);
+        p.popInt("planner", planner);
+        p.popInt("tracePoints", tracePoints);
+        p.popInt("race", race);
+        p.popInt("raceRestarts", raceRestarts);
 
         p.popString("eval", eval);
+        p.popString("boundsFile", boundsFile);
+        p.popString("constraint", constraint);
+        p.popString("experiment", experiment);
+        p.popString("experimentEvals", experimentEvals);
+        p.popString("traceFile", traceFile);
+        p.popString("sharedFile", sharedFile);
+        p.popString("batch", batch);
+        p.popString("batchOut", batchOut);
+        p.popString("shiftFile", shiftFile);
+        p.popString("rotationFile", rotationFile);
+        p.popString("outOfCore", outOfCore);
+        p.popString("loadElite", loadElite);
+        p.popString("saveElite", saveElite);
+
+        if (!boundsFile.empty())
+            loadBounds(boundsFile);
+    }
+
+    // One line per dimension with "min max", or "min max int" for integer
+    // dimensions. Empty lines and lines starting with # are ignored. The
+    // number of dimensions is taken from the file.
+    void
+    loadBounds(std::string const & filename)
+    {
+        std::ifstream in(filename);
+
+        if (!in.good())
+            error("Could not open bounds file:", filename);
+
+        dimMin.clear();
+        dimMax.clear();
+        intDims.clear();
+
+        std::string line;
+
+        while (std::getline(in, line))
+        {
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            std::stringstream ss(line);
+            Precision lower, upper;
+            std::string kind;
+
+            if (!(ss >> lower >> upper) || lower > upper)
+                error("Invalid bounds in line:", line);
+
+            if (ss >> kind)
+            {
+                if (kind != "int")
+                    error("Unknown dimension kind:", kind);
+
+                if (std::ceil(lower) > std::floor(upper))
+                    error("No integer within the bounds of line:", line);
+
+                intDims.push_back(dimMin.size());
+            }
+
+            dimMin.push_back(lower);
+            dimMax.push_back(upper);
+        }
+
+        dims = dimMin.size();
+    }
+
+    // Rows allocated for the population, the largest size a run may reach
+    int
+    popCapacity() const
+    {
+        return popSizing == PopSizing::FIXED ? popSize : std::max(popSize, maxPopSize);
     }
 
     void
@@ -118,26 +376,79 @@ public:
 
         print("memStrategy =", memStrategy);
         print("deType =", deType);
+        print("boundStrategy =", boundStrategy);
+        print("popSizing =", popSizing);
+        print("weightAdaptation =", weightAdaptation);
+        print("initStrategy =", initStrategy);
+        print("localSearch =", localSearch);
 
         print("mutationRate =", mutationRate);
         print("communicationProbability =", communicationProbability);
         print("maxVelocity =", maxVelocity);
 
-//        print("blockSize =", blockSize);
+        print("blockSize =", blockSize);
+        print("blockGens =", blockGens);
         print("dims =", dims);
         print("xMin =", xMin);
         print("xMax =", xMax);
+        print("hvRef =", hvRef);
+        print("raceTarget =", raceTarget);
+        print("raceCheck =", raceCheck);
+        print("raceRatio =", raceRatio);
+        print("deadline =", deadline);
+        print("noiseZ =", noiseZ);
+        print("noiseSigma =", noiseSigma);
+        print("eliteFraction =", eliteFraction);
         print("popSize =", popSize);
+        print("minPopSize =", minPopSize);
+        print("maxPopSize =", maxPopSize);
+        print("popSuccess =", popSuccess);
+        print("historyScale =", historyScale);
         print("memGBestSize =", memGBestSize);
+        print("historySize =", historySize);
+        print("archiveSize =", archiveSize);
         print("maxFitEval =", maxFitEval);
         print("maxGen =", maxGen);
         print("maxGenWoChangeBest =", maxGenWoChangeBest);
         print("printConvergenceResults =", printConvergenceResults);
         print("maxRun =", maxRun);
         print("threads =", threads);
-        print("ntupleDims =", ntupleDims);
+        print("seed =", seed);
+        print("experimentSeeds =", experimentSeeds);
+        print("deltaEval =", deltaEval);
+        print("opposition =", opposition);
+        print("pipeline =", pipeline);
+        print("noiseSamples =", noiseSamples);
+        print("fused =", fused);
+        print("trafficBench =", trafficBench);
+        print("eliteSize =", eliteSize);
+        print("suiteSeed =", suiteSeed);
+        print("localEvery =", localEvery);
+        print("localBudget =", localBudget);
+        print("sharedTop =", sharedTop);
+        print("sharedCache =", sharedCache);
+        print("sharedEvery =", sharedEvery);
+        print("numa =", numa);
+        print("planner =", planner);
+        print("tracePoints =", tracePoints);
+        print("race =", race);
+        print("raceRestarts =", raceRestarts);
 
         print("eval =", eval);
+        print("boundsFile =", boundsFile);
+        print("constraint =", constraint);
+        print("experiment =", experiment);
+        print("experimentEvals =", experimentEvals);
+        print("traceFile =", traceFile);
+        print("sharedFile =", sharedFile);
+        print("batch =", batch);
+        print("batchOut =", batchOut);
+        print("shiftFile =", shiftFile);
+        print("rotationFile =", rotationFile);
+        print("outOfCore =", outOfCore);
+        print("loadElite =", loadElite);
+        print("saveElite =", saveElite);
+        print("intDims =", intDims.size());
 
         printn(NORMAL);
     }
@@ -9,11 +9,32 @@ SOURCES += \
         main.cpp
 
 HEADERS += \
+    anytime.hpp \
+    batch.hpp \
+    ccdeepso.hpp \
     cdeepso.hpp \
     cdeepso_params.hpp \
+    constraints.hpp \
+    delta.hpp \
+    elite.hpp \
+    experiment.hpp \
+    fused.hpp \
     functions.hpp \
-    ntuplecdeepso.hpp \
+    init.hpp \
+    local.hpp \
+    matrix.hpp \
+    mocdeepso.hpp \
+    noise.hpp \
+    numa.hpp \
     operations.hpp \
+    pareto.hpp \
+    planner.hpp \
     population.hpp \
+    race.hpp \
+    rotated.hpp \
+    shared.hpp \
+    rng.hpp \
+    trace.hpp \
+    traffic.hpp \
     utils.hpp \
     weight.hpp
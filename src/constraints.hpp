@@ -0,0 +1,100 @@
+#ifndef CONSTRAINTS_HPP
+#define CONSTRAINTS_HPP
+
+#include "population.hpp"
+
+#include <limits>
+
+// Evaluator for constrained problems. CONSTRAINTS writes the total violation
+// of every refreshed particle (0 when feasible) and OBJECTIVE is a regular
+// population evaluator. The constraints run first and the objective is only
+// called for the feasible particles, infeasible ones get an infinite fitness
+// and are compared by their violation alone.
+//
+// The refresh flag of the skipped particles is cleared, so CDEEPSO only counts
+// the objective evaluations that really happened in fitEval.
+template <typename OBJECTIVE, typename CONSTRAINTS>
+class ConstrainedEval
+{
+public:
+
+    OBJECTIVE objective;
+    CONSTRAINTS constraints;
+
+    long constraintEvals;
+    long skippedEvals;
+
+public:
+
+    ConstrainedEval(OBJECTIVE objective, CONSTRAINTS constraints) :
+        objective(objective),
+        constraints(constraints),
+        constraintEvals(0),
+        skippedEvals(0)
+    {
+
+    }
+
+    void
+    operator()(Particles & particles,
+               Refreshes & refresh,
+               Fitness & fitness,
+               Violations & violation)
+    {
+        constraints(particles, refresh, violation);
+
+        for (uint i=0;i!=refresh.size();++i)
+        {
+            if (!refresh[i])
+                continue;
+
+            ++constraintEvals;
+
+            if (violation[i] > 0.0)
+            {
+                fitness[i] = std::numeric_limits<Precision>::infinity();
+                refresh[i] = false;
+                ++skippedEvals;
+            }
+        }
+
+        objective(particles, refresh, fitness);
+    }
+};
+
+template <typename OBJECTIVE, typename CONSTRAINTS>
+ConstrainedEval<OBJECTIVE, CONSTRAINTS>
+constrained(OBJECTIVE objective, CONSTRAINTS constraints)
+{
+    return ConstrainedEval<OBJECTIVE, CONSTRAINTS>(objective, constraints);
+}
+
+// Evaluates the refreshed particles and their violations. Unconstrained
+// evaluators leave every refreshed particle feasible.
+template <typename EVAL>
+void
+evaluate(EVAL & eval,
+         Particles & particles,
+         Refreshes & refresh,
+         Fitness & fitness,
+         Violations & violation)
+{
+    eval(particles, refresh, fitness);
+
+    for (uint i=0;i!=refresh.size();++i)
+        if (refresh[i])
+            violation[i] = 0.0;
+}
+
+template <typename OBJECTIVE, typename CONSTRAINTS>
+void
+evaluate(ConstrainedEval<OBJECTIVE, CONSTRAINTS> & eval,
+         Particles & particles,
+         Refreshes & refresh,
+         Fitness & fitness,
+         Violations & violation)
+{
+    eval(particles, refresh, fitness, violation);
+}
+
+#endif // CONSTRAINTS_HPP
@@ -0,0 +1,322 @@
+#ifndef DELTA_HPP
+#define DELTA_HPP
+
+#include "constraints.hpp"
+#include "population.hpp"
+
+#include <algorithm>
+
+// Incremental evaluation for separable and partially separable objectives.
+//
+// A kernel describes the objective as numTerms(dims) terms. Each term has an
+// additive part and a multiplicative factor, and the fitness is
+// finalize(sum of additive parts, product of factors, dims). Coordinate j
+// only influences the terms in [firstTerm(j), lastTerm(j, dims)).
+
+class RastriginKernel
+{
+public:
+
+    static const bool multiplicative = false;
+
+    static int numTerms(int const dims) { return dims; }
+    static int firstTerm(int const j) { return j; }
+    static int lastTerm(int const j, int const dims) { UNUSED(dims); return j + 1; }
+
+    static void
+    term(Precision const * const x, int const t, int const dims, Precision & add, Precision & mul)
+    {
+        UNUSED(dims);
+        add = x[t]*x[t] - 10 * cos(2 * M_PI * x[t]) + 10;
+        mul = 1.0;
+    }
+
+    static Precision
+    finalize(Precision const sum, Precision const prod, int const dims)
+    {
+        UNUSED(prod);
+        UNUSED(dims);
+        return sum;
+    }
+};
+
+class GriewankKernel
+{
+public:
+
+    static const bool multiplicative = true;
+
+    static int numTerms(int const dims) { return dims; }
+    static int firstTerm(int const j) { return j; }
+    static int lastTerm(int const j, int const dims) { UNUSED(dims); return j + 1; }
+
+    static void
+    term(Precision const * const x, int const t, int const dims, Precision & add, Precision & mul)
+    {
+        UNUSED(dims);
+        add = x[t]*x[t];
+        mul = cos( x[t] / sqrt(t+1) );
+    }
+
+    static Precision
+    finalize(Precision const sum, Precision const prod, int const dims)
+    {
+        UNUSED(dims);
+        return 1 + sum / 4000 - prod;
+    }
+};
+
+class RosenbrockKernel
+{
+public:
+
+    static const bool multiplicative = false;
+
+    static int numTerms(int const dims) { return dims - 1; }
+    static int firstTerm(int const j) { return j == 0 ? 0 : j - 1; }
+    static int lastTerm(int const j, int const dims) { return j < dims - 1 ? j + 1 : dims - 1; }
+
+    static void
+    term(Precision const * const x, int const t, int const dims, Precision & add, Precision & mul)
+    {
+        UNUSED(dims);
+        Precision term1 = x[t+1] - x[t]*x[t];
+        Precision term2 = 1 - x[t];
+        add = 100 * term1*term1 + term2*term2;
+        mul = 1.0;
+    }
+
+    static Precision
+    finalize(Precision const sum, Precision const prod, int const dims)
+    {
+        UNUSED(prod);
+        UNUSED(dims);
+        return sum;
+    }
+};
+
+// Population evaluator that caches the terms of a reference row per particle
+// (myBest in heuristicRand). A candidate that differs from its reference in k
+// coordinates is evaluated from the cached terms in O(k) term computations.
+// The cache of a slot is rebuilt from scratch when its reference changes, so
+// errors do not accumulate across generations.
+template <typename KERNEL>
+class DeltaEvaluator
+{
+public:
+
+    int dims;
+    int terms;
+
+    Matrix<Precision> refRows;
+    Matrix<Precision> refAdd;
+    Matrix<Precision> refMul;
+    vector<Precision> refSum;
+    vector<Precision> refProd;
+    vector<bool> refValid;
+
+    vector<int> touched;
+    vector<int> stamp;
+    int currentStamp;
+
+    long fullEvals;
+    long deltaEvals;
+
+public:
+
+    // storage as in Matrix, the cache follows the populations out of core
+    DeltaEvaluator(int const popSize,
+                   int const dims,
+                   std::string const & storage="") :
+        dims(dims),
+        terms(KERNEL::numTerms(dims)),
+        refRows(popSize, dims, 0, storage),
+        refAdd(popSize, terms, 0, storage),
+        refMul(popSize, terms, 0, storage),
+        refSum(popSize),
+        refProd(popSize),
+        refValid(popSize, false),
+        stamp(terms, 0),
+        currentStamp(0),
+        fullEvals(0),
+        deltaEvals(0)
+    {
+        touched.reserve(terms);
+    }
+
+    Precision
+    full(Precision const * const x)
+    {
+        Precision sum = 0.0;
+        Precision prod = 1.0;
+        Precision add, mul;
+
+        for (int t=0;t!=terms;++t)
+        {
+            KERNEL::term(x, t, dims, add, mul);
+            sum += add;
+            if (KERNEL::multiplicative)
+                prod *= mul;
+        }
+
+        ++fullEvals;
+        return KERNEL::finalize(sum, prod, dims);
+    }
+
+    void
+    operator()(Particles & particles,
+               Refreshes & refresh,
+               Fitness & fitness)
+    {
+        for (uint i=0;i!=particles.numRows();++i)
+            if (refresh[i])
+                fitness[i] = full(&particles(i,0));
+    }
+
+    void
+    cacheReference(int const slot,
+                   Precision const * const ref)
+    {
+        Precision * const row = &refRows(slot,0);
+        Precision * const add = &refAdd(slot,0);
+        Precision * const mul = &refMul(slot,0);
+
+        if (refValid[slot] && std::equal(ref, ref + dims, row))
+            return;
+
+        std::copy(ref, ref + dims, row);
+        refSum[slot] = 0.0;
+        refProd[slot] = 1.0;
+
+        for (int t=0;t!=terms;++t)
+        {
+            KERNEL::term(row, t, dims, add[t], mul[t]);
+            refSum[slot] += add[t];
+            if (KERNEL::multiplicative)
+                refProd[slot] *= mul[t];
+        }
+
+        refValid[slot] = true;
+    }
+
+    Precision
+    delta(int const slot,
+          Precision const * const x)
+    {
+        Precision const * const row = &refRows(slot,0);
+        Precision const * const add = &refAdd(slot,0);
+        Precision const * const mul = &refMul(slot,0);
+
+        touched.clear();
+        ++currentStamp;
+
+        for (int j=0;j!=dims;++j)
+        {
+            if (x[j] == row[j])
+                continue;
+
+            for (int t=KERNEL::firstTerm(j);t<KERNEL::lastTerm(j, dims);++t)
+            {
+                if (stamp[t] != currentStamp)
+                {
+                    stamp[t] = currentStamp;
+                    touched.push_back(t);
+                }
+            }
+
+            if (int(touched.size()) * 2 > terms)
+                return full(x);
+        }
+
+        Precision sum = refSum[slot];
+        Precision prod = refProd[slot];
+        Precision newAdd, newMul;
+        bool rebuildProd = false;
+
+        for (int t : touched)
+        {
+            KERNEL::term(x, t, dims, newAdd, newMul);
+            sum += newAdd - add[t];
+
+            if (KERNEL::multiplicative)
+            {
+                if (std::abs(mul[t]) < 1e-6)
+                    rebuildProd = true;
+                else
+                    prod = prod / mul[t] * newMul;
+            }
+        }
+
+        // Dividing by a factor close to zero is unstable, recompute the product
+        if (rebuildProd)
+        {
+            prod = 1.0;
+            ++currentStamp;
+
+            for (int t : touched)
+                stamp[t] = currentStamp;
+
+            for (int t=0;t!=terms;++t)
+            {
+                if (stamp[t] == currentStamp)
+                    KERNEL::term(x, t, dims, newAdd, newMul);
+                else
+                    newMul = mul[t];
+                prod *= newMul;
+            }
+        }
+
+        ++deltaEvals;
+        return KERNEL::finalize(sum, prod, dims);
+    }
+
+    void
+    evaluateNear(Particles & particles,
+                 Refreshes & refresh,
+                 Fitness & fitness,
+                 Particles const & reference)
+    {
+        for (uint i=0;i!=particles.numRows();++i)
+        {
+            if (refresh[i])
+            {
+                cacheReference(i, &reference(i,0));
+                fitness[i] = delta(i, &particles(i,0));
+            }
+        }
+    }
+
+};
+
+// Evaluates particles that are expected to be close to the matching rows of
+// reference. Plain evaluators ignore the reference.
+template <typename EVAL>
+void
+evaluateNear(EVAL & eval,
+             Particles & particles,
+             Refreshes & refresh,
+             Fitness & fitness,
+             Violations & violation,
+             Particles const & reference)
+{
+    UNUSED(reference);
+    evaluate(eval, particles, refresh, fitness, violation);
+}
+
+template <typename KERNEL>
+void
+evaluateNear(DeltaEvaluator<KERNEL> & eval,
+             Particles & particles,
+             Refreshes & refresh,
+             Fitness & fitness,
+             Violations & violation,
+             Particles const & reference)
+{
+    eval.evaluateNear(particles, refresh, fitness, reference);
+
+    for (uint i=0;i!=refresh.size();++i)
+        if (refresh[i])
+            violation[i] = 0.0;
+}
+
+#endif // DELTA_HPP
@@ -0,0 +1,193 @@
+#ifndef ELITE_HPP
+#define ELITE_HPP
+
+#include "operations.hpp"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+// Best solutions of a run, kept to warm start the next run of a recurring
+// job. An entry holds a position, the strategic parameters of its particle
+// and the fitness and violation it had. These only rank the entries, a warm
+// started run evaluates the positions again.
+//
+// The file is text: a "dims n" line and then one line per entry with the
+// fitness, the violation, the six weights and the n coordinates. Empty lines
+// and lines starting with # are ignored.
+class EliteSet
+{
+public:
+
+    class Entry
+    {
+    public:
+        vector<Precision> x;
+        Weight weight;
+        Precision fitness;
+        Precision violation;
+    };
+
+    int dims;
+    vector<Entry> entries;
+
+public:
+
+    EliteSet(int const dims=0) :
+        dims(dims)
+    {
+
+    }
+
+    bool
+    empty() const
+    {
+        return entries.empty();
+    }
+
+    void
+    add(Precision const * const x,
+        Weight const & weight,
+        Precision const fitness,
+        Precision const violation)
+    {
+        Entry e;
+        e.x.assign(x, x + dims);
+        e.weight = weight;
+        e.weight.generator = nullptr;
+        e.fitness = fitness;
+        e.violation = violation;
+        entries.push_back(e);
+    }
+
+    void
+    merge(EliteSet const & other)
+    {
+        if (other.empty())
+            return;
+
+        if (empty())
+            dims = other.dims;
+
+        if (other.dims != dims)
+            error("Elite sets with different dims:", dims, "and", other.dims);
+
+        entries.insert(entries.end(), other.entries.begin(), other.entries.end());
+    }
+
+    // Sorts the entries best first and keeps the n best distinct positions
+    void
+    keepBest(uint const n)
+    {
+        std::stable_sort(entries.begin(), entries.end(), [](Entry const & a, Entry const & b) {
+            return ops::isBetter(a.fitness, a.violation, b.fitness, b.violation);
+        });
+
+        vector<Entry> kept;
+
+        for (uint i=0;i!=entries.size() && kept.size() < n;++i)
+        {
+            bool repeated = false;
+
+            for (uint k=0;k!=kept.size() && !repeated;++k)
+                repeated = kept[k].x == entries[i].x;
+
+            if (!repeated)
+                kept.push_back(entries[i]);
+        }
+
+        entries.swap(kept);
+    }
+
+    void
+    load(std::string const & filename)
+    {
+        std::ifstream in(filename);
+
+        if (!in.good())
+            error("Could not open elite file:", filename);
+
+        entries.clear();
+        dims = 0;
+
+        std::string line;
+
+        while (std::getline(in, line))
+        {
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            std::stringstream ss(line);
+
+            if (dims == 0)
+            {
+                std::string key;
+                if (!(ss >> key >> dims) || key != "dims" || dims <= 0)
+                    error("Elite file must start with a dims line:", filename);
+                continue;
+            }
+
+            // strtod, unlike operator>>, reads the inf fitness of infeasible
+            // entries back
+            vector<Precision> values;
+            std::string token;
+
+            while (ss >> token)
+            {
+                char * end;
+                values.push_back(std::strtod(token.c_str(), &end));
+
+                if (*end != '\0')
+                    error("Invalid value in elite file:", token);
+            }
+
+            if (int(values.size()) != dims + 8)
+                error("Elite entry must hold", dims + 8, "values:", line);
+
+            Entry e;
+            Weight & w = e.weight;
+
+            e.fitness = values[0];
+            e.violation = values[1];
+            w.generator = nullptr;
+            w.pInertia = values[2];
+            w.pMemory = values[3];
+            w.pCooperation = values[4];
+            w.pPerturbation = values[5];
+            w.dThreshold = values[6];
+            w.dVelocity = values[7];
+            e.x.assign(values.begin() + 8, values.end());
+
+            entries.push_back(e);
+        }
+    }
+
+    void
+    save(std::string const & filename) const
+    {
+        std::ofstream out(filename);
+
+        if (!out.good())
+            error("Could not write elite file:", filename);
+
+        out << "# fitness violation pInertia pMemory pCooperation pPerturbation dThreshold dVelocity x...\n";
+        out << "dims " << dims << "\n";
+        out.precision(17);
+
+        for (auto & e : entries)
+        {
+            Weight const & w = e.weight;
+
+            out << e.fitness << " " << e.violation << " "
+                << w.pInertia << " " << w.pMemory << " " << w.pCooperation << " "
+                << w.pPerturbation << " " << w.dThreshold << " " << w.dVelocity;
+
+            for (int j=0;j!=dims;++j)
+                out << " " << e.x[j];
+
+            out << "\n";
+        }
+    }
+};
+
+#endif // ELITE_HPP
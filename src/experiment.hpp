@@ -0,0 +1,443 @@
+#ifndef EXPERIMENT_HPP
+#define EXPERIMENT_HPP
+
+#include "cdeepso.hpp"
+#include "functions.hpp"
+
+#include <cstdint>
+#include <fstream>
+#include <sys/stat.h>
+
+// Statistical comparison of the CDEEPSO strategies. Every combination of
+// deType x memStrategy x eval function runs once per seed, all jobs in
+// parallel. Each job records its convergence curve (best fitness vs fitEval)
+// and the experiment writes:
+//
+//   jobs.csv     final fitness per job, with the seed needed to replay it
+//   curves.bin   all convergence curves, see writeCurves for the layout
+//   summary.txt  per eval: median, mean rank, Wilcoxon signed-rank p-value
+//                against the best strategy and ERT per target; plus the
+//                ECDF of reached (run, target) pairs per strategy
+//
+// Seeds are p.seed (or 1) up to p.seed + experimentSeeds - 1 and are shared by
+// all strategies, so the rank test pairs the runs by seed. A job is replayed
+// with ./main -eval E -deType D -memStrategy M -seed S -maxRun 1.
+class Experiment
+{
+public:
+
+    class Job
+    {
+    public:
+        CDEEPSOParams::DEType deType;
+        CDEEPSOParams::MemStrategy memStrategy;
+        int evalIndex;
+        int seed;
+
+        Precision finalFit;
+        int finalFitEval;
+        vector<int> curveEvals;
+        vector<Precision> curveFits;
+
+        Job() : finalFit(0.0), finalFitEval(0) { }
+    };
+
+    CDEEPSOParams & p;
+
+    vector<std::string> evals;
+    vector<CDEEPSOParams::DEType> deTypes;
+    vector<CDEEPSOParams::MemStrategy> memStrategies;
+    vector<Precision> targets;
+    vector<Job> jobs;
+
+public:
+
+    Experiment(CDEEPSOParams & p) :
+        p(p),
+        deTypes({CDEEPSOParams::DEType::RAND, CDEEPSOParams::DEType::BEST}),
+        memStrategies({CDEEPSOParams::MemStrategy::POS, CDEEPSOParams::MemStrategy::MEM, CDEEPSOParams::MemStrategy::POS_MEM})
+    {
+        std::stringstream ss(p.experimentEvals);
+        std::string name;
+        while (std::getline(ss, name, ','))
+            if (!name.empty())
+                evals.push_back(name);
+
+        // All built-in functions have their optimum at 0
+        for (int k=2;k>=-8;--k)
+            targets.push_back(std::pow(10.0, k));
+
+        const int firstSeed = p.seed ? p.seed : 1;
+
+        for (uint s=0;s!=numStrategies();++s)
+        {
+            for (uint e=0;e!=evals.size();++e)
+            {
+                for (int k=0;k!=p.experimentSeeds;++k)
+                {
+                    Job job;
+                    job.deType = deTypes[s / memStrategies.size()];
+                    job.memStrategy = memStrategies[s % memStrategies.size()];
+                    job.evalIndex = e;
+                    job.seed = firstSeed + k;
+                    jobs.push_back(job);
+                }
+            }
+        }
+    }
+
+    uint
+    numStrategies() const
+    {
+        return deTypes.size() * memStrategies.size();
+    }
+
+    // Jobs are laid out as strategy x eval x seed
+    Job &
+    job(int const strategy,
+        int const eval,
+        int const k)
+    {
+        return jobs[(strategy * evals.size() + eval) * p.experimentSeeds + k];
+    }
+
+    std::string
+    strategyName(int const s) const
+    {
+        static const char * deNames[] = {"", "", "RAND", "BEST"};
+        static const char * memNames[] = {"", "POS", "MEM", "POS_MEM"};
+        return cat(deNames[deTypes[s / memStrategies.size()]], "/", memNames[memStrategies[s % memStrategies.size()]]);
+    }
+
+    void
+    run()
+    {
+        wup::parallel(p.threads, jobs.size(), [&](const int tid, const int jid) {
+            UNUSED(tid);
+
+            Job & job = jobs[jid];
+            CDEEPSOParams jp = p;
+            jp.deType = job.deType;
+            jp.memStrategy = job.memStrategy;
+            jp.eval = evals[job.evalIndex];
+            jp.seed = job.seed;
+            jp.printConvergenceResults = 0;
+
+            EvalFunction eval = findEval(jp.eval);
+            CDEEPSO m(jp);
+
+            m.setOnLoopListener([&](int const generation, CDEEPSO & m) {
+                UNUSED(generation);
+                job.curveEvals.push_back(m.fitEval);
+                job.curveFits.push_back(m.gBestFit);
+            });
+
+            m.optimize(eval);
+
+            job.finalFit = m.gBestFit;
+            job.finalFitEval = m.fitEval;
+        });
+    }
+
+    void
+    write(std::string const & dir)
+    {
+        mkdir(dir.c_str(), 0755);
+        writeJobs(dir + "/jobs.csv");
+        writeCurves(dir + "/curves.bin");
+        writeSummary(dir + "/summary.txt");
+    }
+
+    void
+    writeJobs(std::string const & filename)
+    {
+        std::ofstream out(filename);
+        out << "strategy,eval,seed,fitness,fitEval\n";
+
+        for (auto & job : jobs)
+            out << strategyName(strategyOf(job)) << "," << evals[job.evalIndex] << ","
+                << job.seed << "," << job.finalFit << "," << job.finalFitEval << "\n";
+    }
+
+    // Little endian binary: "CDCV", int32 numJobs, then per job int32 deType,
+    // memStrategy, evalIndex, seed and numPoints, followed by numPoints int32
+    // fitEvals and numPoints float32 best fitness values
+    void
+    writeCurves(std::string const & filename)
+    {
+        std::ofstream out(filename, std::ios::binary);
+        out.write("CDCV", 4);
+        writeInt(out, jobs.size());
+
+        for (auto & job : jobs)
+        {
+            writeInt(out, job.deType);
+            writeInt(out, job.memStrategy);
+            writeInt(out, job.evalIndex);
+            writeInt(out, job.seed);
+            writeInt(out, job.curveEvals.size());
+
+            for (int e : job.curveEvals)
+                writeInt(out, e);
+
+            for (Precision f : job.curveFits)
+            {
+                const float v = f;
+                out.write(reinterpret_cast<const char*>(&v), sizeof(v));
+            }
+        }
+    }
+
+    void
+    writeSummary(std::string const & filename)
+    {
+        std::ofstream out(filename);
+        const int seeds = p.experimentSeeds;
+
+        for (uint e=0;e!=evals.size();++e)
+        {
+            out << "# eval " << evals[e] << "\n";
+
+            vector<vector<Precision>> finals(numStrategies(), vector<Precision>(seeds));
+            for (uint s=0;s!=numStrategies();++s)
+                for (int k=0;k!=seeds;++k)
+                    finals[s][k] = job(s, e, k).finalFit;
+
+            vector<Precision> meanRanks = meanRanksPerSeed(finals);
+
+            uint best = 0;
+            for (uint s=1;s!=numStrategies();++s)
+                if (median(finals[s]) < median(finals[best]))
+                    best = s;
+
+            out << "strategy median mean_rank wilcoxon_p_vs_best";
+            for (Precision t : targets)
+                out << " ERT(" << t << ")";
+            out << "\n";
+
+            for (uint s=0;s!=numStrategies();++s)
+            {
+                out << strategyName(s) << " " << median(finals[s]) << " " << meanRanks[s] << " ";
+                out << (s == best ? 1.0 : wilcoxonSignedRank(finals[s], finals[best]));
+
+                for (Precision t : targets)
+                    out << " " << ert(s, e, t);
+                out << "\n";
+            }
+
+            out << "\n";
+        }
+
+        out << "# ECDF of (run, target) pairs reached within the budget, all evals\n";
+        out << "strategy";
+
+        vector<int> budgets;
+        for (int b=p.popSize;b<p.maxFitEval;b*=2)
+            budgets.push_back(b);
+        budgets.push_back(p.maxFitEval);
+
+        for (int b : budgets)
+            out << " " << b;
+        out << "\n";
+
+        for (uint s=0;s!=numStrategies();++s)
+        {
+            out << strategyName(s);
+            for (int b : budgets)
+                out << " " << ecdf(s, b);
+            out << "\n";
+        }
+    }
+
+    // Expected running time: evaluations spent over all runs until they hit the
+    // target, or their whole budget when they did not, divided by the hits
+    Precision
+    ert(int const s,
+        int const e,
+        Precision const target)
+    {
+        long spent = 0;
+        int hits = 0;
+
+        for (int k=0;k!=p.experimentSeeds;++k)
+        {
+            const int hit = firstHit(job(s, e, k), target);
+
+            if (hit >= 0)
+            {
+                spent += hit;
+                hits += 1;
+            }
+            else
+            {
+                spent += job(s, e, k).finalFitEval;
+            }
+        }
+
+        return hits ? Precision(spent) / hits : std::numeric_limits<Precision>::infinity();
+    }
+
+    Precision
+    ecdf(int const s,
+         int const budget)
+    {
+        int reached = 0;
+        int total = 0;
+
+        for (uint e=0;e!=evals.size();++e)
+        {
+            for (int k=0;k!=p.experimentSeeds;++k)
+            {
+                for (Precision t : targets)
+                {
+                    const int hit = firstHit(job(s, e, k), t);
+                    reached += hit >= 0 && hit <= budget;
+                    total += 1;
+                }
+            }
+        }
+
+        return total ? Precision(reached) / total : 0.0;
+    }
+
+    static int
+    firstHit(Job const & job,
+             Precision const target)
+    {
+        for (uint i=0;i!=job.curveFits.size();++i)
+            if (job.curveFits[i] <= target)
+                return job.curveEvals[i];
+        return -1;
+    }
+
+    static Precision
+    median(vector<Precision> values)
+    {
+        std::sort(values.begin(), values.end());
+        const size_t n = values.size();
+        return n % 2 ? values[n/2] : (values[n/2-1] + values[n/2]) / 2;
+    }
+
+    // Rank of each strategy among all strategies for the same seed, averaged
+    static vector<Precision>
+    meanRanksPerSeed(vector<vector<Precision>> const & finals)
+    {
+        const int strategies = finals.size();
+        const int seeds = finals[0].size();
+        vector<Precision> meanRanks(strategies, 0.0);
+        vector<Precision> column(strategies);
+        vector<Precision> ranks;
+
+        for (int k=0;k!=seeds;++k)
+        {
+            for (int s=0;s!=strategies;++s)
+                column[s] = finals[s][k];
+
+            averageRanks(column, ranks);
+
+            for (int s=0;s!=strategies;++s)
+                meanRanks[s] += ranks[s] / seeds;
+        }
+
+        return meanRanks;
+    }
+
+    // Ranks starting at 1, ties get the average of their ranks
+    static void
+    averageRanks(vector<Precision> const & values,
+                 vector<Precision> & ranks)
+    {
+        const int n = values.size();
+        vector<int> order(n);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](int a, int b) { return values[a] < values[b]; });
+
+        ranks.resize(n);
+
+        for (int i=0;i!=n;)
+        {
+            int j = i;
+            while (j + 1 != n && values[order[j+1]] == values[order[i]])
+                ++j;
+
+            for (int k=i;k<=j;++k)
+                ranks[order[k]] = (i + j) / 2.0 + 1.0;
+
+            i = j + 1;
+        }
+    }
+
+    // Two sided Wilcoxon signed-rank test of paired samples, with the normal
+    // approximation and tie correction. Zero differences are dropped.
+    static Precision
+    wilcoxonSignedRank(vector<Precision> const & a,
+                       vector<Precision> const & b)
+    {
+        vector<Precision> absDiffs;
+        vector<int> signs;
+
+        for (uint i=0;i!=a.size();++i)
+        {
+            const Precision d = a[i] - b[i];
+            if (d != 0.0)
+            {
+                absDiffs.push_back(std::abs(d));
+                signs.push_back(d > 0 ? 1 : -1);
+            }
+        }
+
+        const int n = absDiffs.size();
+        if (n == 0)
+            return 1.0;
+
+        vector<Precision> ranks;
+        averageRanks(absDiffs, ranks);
+
+        Precision wPlus = 0.0;
+        for (int i=0;i!=n;++i)
+            if (signs[i] > 0)
+                wPlus += ranks[i];
+
+        vector<Precision> sorted = absDiffs;
+        std::sort(sorted.begin(), sorted.end());
+
+        Precision tieCorrection = 0.0;
+        for (int i=0;i!=n;)
+        {
+            int j = i;
+            while (j != n && sorted[j] == sorted[i])
+                ++j;
+            const Precision t = j - i;
+            tieCorrection += t * t * t - t;
+            i = j;
+        }
+
+        const Precision mean = n * (n + 1) / 4.0;
+        const Precision var = n * (n + 1) * (2 * n + 1) / 24.0 - tieCorrection / 48.0;
+
+        if (var <= 0.0)
+            return 1.0;
+
+        const Precision z = (std::abs(wPlus - mean) - 0.5) / std::sqrt(var);
+        return z <= 0.0 ? 1.0 : std::erfc(z / std::sqrt(2.0));
+    }
+
+private:
+
+    int
+    strategyOf(Job const & job) const
+    {
+        const int d = std::find(deTypes.begin(), deTypes.end(), job.deType) - deTypes.begin();
+        const int m = std::find(memStrategies.begin(), memStrategies.end(), job.memStrategy) - memStrategies.begin();
+        return d * memStrategies.size() + m;
+    }
+
+    static void
+    writeInt(std::ofstream & out,
+             int32_t const value)
+    {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+};
+
+#endif // EXPERIMENT_HPP
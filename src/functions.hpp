@@ -51,6 +51,13 @@ rastrigin(const Precision * const x, const int len)
     return 10 * len + fit;
 }
 
+Precision
+rastriginTerm(const Precision x, const int j)
+{
+    UNUSED(j);
+    return x*x - 10 * cos(2 * M_PI * x) + 10;
+}
+
 
 //////////////////////////////////////////////////////////////////////////////////////////
 // Population functions
@@ -87,6 +94,142 @@ rastrigin(Particles & particles,
 }
 
 
+typedef void (*EvalFunction)(Particles & particles,
+                             Refreshes & refresh,
+                             Fitness & fitness);
+
+EvalFunction
+findEval(std::string const & name)
+{
+    if (name == "ras") return rastrigin;
+    if (name == "ros") return rosenbrock;
+    if (name == "gri") return griewank;
+
+    error("Invalid eval function:", name);
+    return nullptr;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Multi-objective functions, x in [0,1]
+//////////////////////////////////////////////////////////////////////////////////////////
+
+Precision
+zdtG(const Precision * const x, const int len)
+{
+    Precision sum = 0.0;
+    for (int i=1;i!=len;++i)
+        sum += x[i];
+    return 1 + 9 * sum / (len - 1);
+}
+
+void
+zdt1(Particles & particles,
+     Refreshes & refresh,
+     Bundle<Precision> & objectives)
+{
+    for (uint i=0;i!=particles.numRows();++i)
+    {
+        if (!refresh[i])
+            continue;
+
+        const Precision * const x = &particles(i,0);
+        const Precision g = zdtG(x, particles.numCols());
+        objectives(i,0) = x[0];
+        objectives(i,1) = g * (1 - sqrt(x[0] / g));
+    }
+}
+
+void
+zdt2(Particles & particles,
+     Refreshes & refresh,
+     Bundle<Precision> & objectives)
+{
+    for (uint i=0;i!=particles.numRows();++i)
+    {
+        if (!refresh[i])
+            continue;
+
+        const Precision * const x = &particles(i,0);
+        const Precision g = zdtG(x, particles.numCols());
+        objectives(i,0) = x[0];
+        objectives(i,1) = g * (1 - (x[0] / g) * (x[0] / g));
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Constraint functions
+//////////////////////////////////////////////////////////////////////////////////////////
+
+// sum(x) >= dims / 2
+void
+sumConstraint(Particles & particles,
+              Refreshes & refresh,
+              Violations & violation)
+{
+    for (uint i=0;i!=particles.numRows();++i)
+    {
+        if (!refresh[i])
+            continue;
+
+        Precision sum = 0.0;
+        for (uint j=0;j!=particles.numCols();++j)
+            sum += particles(i,j);
+
+        const Precision v = 0.5 * particles.numCols() - sum;
+        violation[i] = v > 0.0 ? v : 0.0;
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Objectives
+//////////////////////////////////////////////////////////////////////////////////////////
+
+// Describes a particle function and, when it is additively separable, the
+// contribution of a single coordinate, so that the sum of term(x[j], j) over
+// all j equals function(x, len).
+class Objective
+{
+public:
+
+    typedef Precision (*Function)(const Precision * const x, const int len);
+    typedef Precision (*Term)(const Precision x, const int j);
+
+    Function function;
+    Term term;
+
+public:
+
+    Objective(Function function=nullptr, Term term=nullptr) :
+        function(function), term(term) { }
+
+    bool
+    separable() const
+    {
+        return term != nullptr;
+    }
+
+    Precision
+    operator()(const Precision * const x, const int len) const
+    {
+        return function(x, len);
+    }
+};
+
+Objective
+findObjective(std::string const & name)
+{
+    if (name == "ras") return Objective(rastrigin, rastriginTerm);
+    if (name == "ros") return Objective(rosenbrock);
+    if (name == "gri") return Objective(griewank);
+
+    error("Invalid eval function:", name);
+    return Objective();
+}
+
+
 //////////////////////////////////////////////////////////////////////////////////////////
 // Other functions
 //////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,113 @@
+#ifndef FUSED_HPP
+#define FUSED_HPP
+
+#include "operations.hpp"
+
+// Fused generation kernels, selected by p.fused. The regular step walks every
+// population several times per stage (clone, velocity, position, limits,
+// merge, personal bests), and at large popSize x dims each walk streams the
+// matrices from memory again. These kernels do the same work for one
+// particle at a time, in tiles of columns small enough that the rows the
+// particle reads and writes stay in L1 until the tile is done.
+//
+// The random numbers are drawn in the order of the regular step, so the
+// results are identical, except with the REINIT bound strategy whose draws
+// move between the ones of the velocity update.
+namespace ops
+{
+
+static const uint fusedTile = 256;
+
+// computeNewVel, computeNewPos and enforceLimits in one pass. Each row of src
+// moves into the same row of dst with the weights of dst; src may be dst.
+// Moving into another population, src holds the parent positions of limits.
+inline void
+moveFused(Population const & src,
+          Population & dst,
+          Random & generator,
+          Population const & myBest,
+          vector<Precision> const & gBest,
+          vector<double> const & vMin,
+          vector<double> const & vMax,
+          Precision const communicationProbability,
+          RowLimits const & limits)
+{
+    const uint dims = src.dims();
+
+    for (uint i=0;i!=dst.size();++i)
+    {
+        const Weight & weight = dst.weights[i];
+        const Precision * pos = & src.particles(i,0);
+        const Precision * vel = & src.velocity(i,0);
+        const Precision * mbp = & myBest.particles(i,0);
+
+        Precision * const newPos = & dst.particles(i,0);
+        Precision * const newVel = & dst.velocity(i,0);
+        Precision const * const par = &src == &dst ? nullptr : pos;
+
+        const Precision noise = 1.0 + weight.pPerturbation * generator.normalDouble();
+
+        for (uint j0=0;j0<dims;j0+=fusedTile)
+        {
+            const uint j1 = std::min(j0 + fusedTile, dims);
+
+            newVelocityRow(weight, pos, vel, mbp, gBest.data(), noise, generator,
+                           vMin, vMax, communicationProbability, newVel, j0, j1);
+
+            for (uint k=j0;k!=j1;++k)
+                newPos[k] = pos[k] + newVel[k];
+
+            limits.apply(newPos, newVel, par, j0, j1);
+        }
+
+        limits.round(newPos);
+    }
+}
+
+// mergePopulations and updateMyBestPos in one pass, a row taken from src is
+// still in cache when it also becomes the personal best. Returns the number
+// of particles that improved their best.
+inline int
+mergeFused(Population const & src,
+           Population & dst,
+           Fitness const & srcFitness,
+           Violations const & srcViolation,
+           Fitness const & dstFitness,
+           Violations const & dstViolation,
+           Population & myBest,
+           Fitness & myBestFitness,
+           Violations & myBestViolation,
+           WeightHistory * const history,
+           Precision const maxVelocity)
+{
+    int improved = 0;
+
+    for (uint i=0;i!=src.size();++i)
+    {
+        if (isBetter(srcFitness[i], srcViolation[i], dstFitness[i], dstViolation[i]))
+        {
+            if (history)
+                history->record(src.weights[i], dstFitness[i] - srcFitness[i], maxVelocity);
+
+            dst.particles.importRow(src.particles, i, i);
+            dst.velocity.importRow(src.velocity, i, i);
+            dst.weights[i] = src.weights[i];
+        }
+
+        if (isBetter(dstFitness[i], dstViolation[i], myBestFitness[i], myBestViolation[i]))
+        {
+            ++improved;
+            myBest.particles.importRow(dst.particles, i, i);
+            myBest.velocity.importRow(dst.velocity, i, i);
+            myBest.weights[i] = dst.weights[i];
+            myBestFitness[i] = dstFitness[i];
+            myBestViolation[i] = dstViolation[i];
+        }
+    }
+
+    return improved;
+}
+
+}
+
+#endif // FUSED_HPP
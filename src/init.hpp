@@ -0,0 +1,292 @@
+#ifndef INIT_HPP
+#define INIT_HPP
+
+#include "population.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+
+// Low discrepancy points in [0, 1)^dims. Dimension j uses the j-th primitive
+// polynomial over GF(2), found by search, with random odd initial direction
+// numbers, and every dimension gets a random digital shift, so each seed
+// draws a different but still well spread point set.
+class SobolSequence
+{
+public:
+
+    int dims;
+    vector<uint32_t> directions;
+    vector<uint32_t> state;
+    uint32_t index;
+
+public:
+
+    SobolSequence(int const dims,
+                  Random & generator) :
+        dims(dims),
+        directions(dims * 32),
+        state(dims),
+        index(0)
+    {
+        uint32_t poly = 1;
+
+        for (int j=0;j!=dims;++j)
+        {
+            uint32_t * const v = &directions[j * 32];
+
+            if (j == 0)
+            {
+                for (int k=0;k!=32;++k)
+                    v[k] = 1u << (31 - k);
+            }
+            else
+            {
+                poly = nextPrimitive(poly);
+                const int s = degree(poly);
+
+                for (int k=0;k!=32;++k)
+                {
+                    if (k < s)
+                    {
+                        const uint32_t m = (uint32_t(generator.uniformInt(1 << k)) << 1) | 1u;
+                        v[k] = m << (31 - k);
+                        continue;
+                    }
+
+                    v[k] = v[k-s] ^ (v[k-s] >> s);
+                    for (int i=1;i!=s;++i)
+                        if ((poly >> (s - i)) & 1u)
+                            v[k] ^= v[k-i];
+                }
+            }
+
+            state[j] = uint32_t(generator.uniformDouble() * 4294967296.0);
+        }
+    }
+
+    // Writes the next point, the all zero first point is skipped
+    void
+    next(Precision * const x)
+    {
+        const int c = __builtin_ctz(~index);
+        ++index;
+
+        for (int j=0;j!=dims;++j)
+        {
+            state[j] ^= directions[j * 32 + c];
+            x[j] = state[j] * (1.0 / 4294967296.0);
+        }
+    }
+
+    static int
+    degree(uint32_t const poly)
+    {
+        return 31 - __builtin_clz(poly);
+    }
+
+    // Smallest primitive polynomial above poly, bit k is the coefficient of x^k
+    static uint32_t
+    nextPrimitive(uint32_t poly)
+    {
+        for (++poly;;++poly)
+            if ((poly & 1u) && isPrimitive(poly))
+                return poly;
+    }
+
+    static bool
+    isPrimitive(uint32_t const poly)
+    {
+        const int s = degree(poly);
+        const uint64_t order = (1ull << s) - 1;
+
+        if (s == 0 || powX(order, poly) != 1)
+            return false;
+
+        uint64_t n = order;
+        for (uint64_t q=2;q*q<=n;++q)
+        {
+            if (n % q)
+                continue;
+
+            if (powX(order / q, poly) == 1)
+                return false;
+
+            while (n % q == 0)
+                n /= q;
+        }
+
+        return n == 1 || n == order || powX(order / n, poly) != 1;
+    }
+
+    // x^e mod poly over GF(2)
+    static uint32_t
+    powX(uint64_t e,
+         uint32_t const poly)
+    {
+        const int s = degree(poly);
+        uint32_t result = 1;
+        uint32_t base = 2 >= (1u << s) ? 2 ^ poly : 2;
+
+        while (e)
+        {
+            if (e & 1)
+                result = mulMod(result, base, poly, s);
+            base = mulMod(base, base, poly, s);
+            e >>= 1;
+        }
+
+        return result;
+    }
+
+    static uint32_t
+    mulMod(uint32_t a,
+           uint32_t b,
+           uint32_t const poly,
+           int const s)
+    {
+        uint32_t r = 0;
+
+        while (b)
+        {
+            if (b & 1)
+                r ^= a;
+            b >>= 1;
+            a <<= 1;
+            if (a & (1u << s))
+                a ^= poly;
+        }
+
+        return r;
+    }
+};
+
+namespace ops
+{
+
+// Unit samples of n points, one row each, drawn in a single batch
+inline void
+sampleUnitCube(CDEEPSOParams::InitStrategy const strategy,
+               Bundle<Precision> & u,
+               uint const n,
+               Random & generator)
+{
+    const uint dims = u.numCols();
+
+    switch (strategy)
+    {
+    case CDEEPSOParams::InitStrategy::LHS:
+    {
+        // One point per stratum in every dimension, strata paired at random
+        vector<int> strata(n);
+
+        for (uint j=0;j!=dims;++j)
+        {
+            std::iota(strata.begin(), strata.end(), 0);
+            generator.shuffle(strata);
+
+            for (uint i=0;i!=n;++i)
+                u(i,j) = (strata[i] + generator.uniformDouble()) / n;
+        }
+        break;
+    }
+
+    case CDEEPSOParams::InitStrategy::HALTON:
+    {
+        // Radical inverses in the first dims primes with a random rotation
+        uint base = 1;
+
+        for (uint j=0;j!=dims;++j)
+        {
+            for (bool prime=false;!prime;)
+            {
+                ++base;
+                prime = true;
+                for (uint d=2;d*d<=base && prime;++d)
+                    prime = base % d != 0;
+            }
+
+            const Precision shift = generator.uniformDouble();
+
+            for (uint i=0;i!=n;++i)
+            {
+                Precision r = 0.0;
+                Precision f = 1.0 / base;
+
+                for (uint k=i+1;k;k/=base,f/=base)
+                    r += f * (k % base);
+
+                r += shift;
+                u(i,j) = r >= 1.0 ? r - 1.0 : r;
+            }
+        }
+        break;
+    }
+
+    case CDEEPSOParams::InitStrategy::SOBOL:
+    {
+        SobolSequence sobol(dims, generator);
+        for (uint i=0;i!=n;++i)
+            sobol.next(&u(i,0));
+        break;
+    }
+
+    case CDEEPSOParams::InitStrategy::UNIFORM:
+    default:
+        for (uint i=0;i!=n;++i)
+            for (uint j=0;j!=dims;++j)
+                u(i,j) = generator.uniformDouble();
+        break;
+    }
+}
+
+// Replaces the positions of the rows from first on with the strategy samples
+inline void
+initPositions(Population & pop,
+              CDEEPSOParams::InitStrategy const strategy,
+              Random & generator,
+              vector<double> const & xMin,
+              vector<double> const & xMax,
+              uint const first=0)
+{
+    if (strategy == CDEEPSOParams::InitStrategy::UNIFORM || first >= pop.size())
+        return;
+
+    const uint n = pop.size() - first;
+    const uint dims = pop.dims();
+    Bundle<Precision> u(n, dims, 0.0);
+
+    sampleUnitCube(strategy, u, n, generator);
+
+    for (uint i=0;i!=n;++i)
+    {
+        Precision * const x = &pop.particles(first + i,0);
+        Precision const * const s = &u(i,0);
+
+        for (uint j=0;j!=dims;++j)
+            x[j] = xMin[j] + (xMax[j] - xMin[j]) * s[j];
+    }
+}
+
+// Mirrors every position inside the bounds: x' = xMin + xMax - x
+inline void
+oppositePositions(Population const & src,
+                  Population & dst,
+                  vector<double> const & xMin,
+                  vector<double> const & xMax)
+{
+    dst.cloneFrom(src);
+
+    for (uint i=0;i!=src.size();++i)
+    {
+        Precision const * const x = &src.particles(i,0);
+        Precision * const o = &dst.particles(i,0);
+
+        for (uint j=0;j!=src.dims();++j)
+            o[j] = xMin[j] + xMax[j] - x[j];
+    }
+}
+
+}
+
+#endif // INIT_HPP
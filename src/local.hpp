@@ -0,0 +1,392 @@
+#ifndef LOCAL_HPP
+#define LOCAL_HPP
+
+#include "constraints.hpp"
+#include "operations.hpp"
+#include "population.hpp"
+
+#include <cmath>
+
+// Budgeted local optimizers used to refine gBest. Every trial point is placed
+// in a row of a scratch batch and the whole batch goes through the same
+// evaluate() as the swarm, so delta and constrained evaluators work unchanged.
+// Points are kept inside the bounds and integer dimensions never move.
+//
+//   COORDINATE  pattern search, the 2 x dims neighbours of x along every axis
+//               form one batch; steps grow on success and halve otherwise
+//   LBFGS       limited memory BFGS with a forward difference gradient (one
+//               batch of dims points) and a line search that tries
+//               lineSteps step lengths in one batch
+//
+// The scratch batch holds the rows of the selected method only, CDEEPSO
+// builds the instance on the first refinement.
+class LocalSearch
+{
+public:
+
+    static const int lbfgsMemory = 5;
+    static const int lineSteps = 4;
+
+    CDEEPSOParams const & p;
+    vector<double> const & xMin;
+    vector<double> const & xMax;
+    vector<bool> fixed;
+
+    Particles rows;
+    Refreshes refresh;
+    Fitness fitness;
+    Violations violation;
+
+    vector<Precision> steps;
+    vector<Precision> grad;
+    vector<Precision> dir;
+    vector<Precision> alpha;
+    vector<vector<Precision>> s;
+    vector<vector<Precision>> y;
+    vector<Precision> rho;
+
+    long evals;
+
+public:
+
+    LocalSearch(CDEEPSOParams const & p,
+                vector<double> const & xMin,
+                vector<double> const & xMax) :
+        p(p),
+        xMin(xMin),
+        xMax(xMax),
+        fixed(p.dims, false),
+        rows(batchRows(p), p.dims, 0),
+        refresh(rows.numRows(), false),
+        fitness(rows.numRows()),
+        violation(rows.numRows()),
+        steps(p.dims),
+        grad(p.dims),
+        dir(p.dims),
+        alpha(lbfgsMemory),
+        s(isLbfgs(p) ? lbfgsMemory : 0, vector<Precision>(p.dims)),
+        y(isLbfgs(p) ? lbfgsMemory : 0, vector<Precision>(p.dims)),
+        rho(lbfgsMemory),
+        evals(0)
+    {
+        for (int j : p.intDims)
+            fixed[j] = true;
+    }
+
+    static bool
+    isLbfgs(CDEEPSOParams const & p)
+    {
+        return p.localSearch == CDEEPSOParams::LocalSearch::LBFGS;
+    }
+
+    // 2 x dims neighbours for COORDINATE, the dims points of the gradient or
+    // the lineSteps points of the line search for LBFGS
+    static int
+    batchRows(CDEEPSOParams const & p)
+    {
+        if (p.localSearch == CDEEPSOParams::LocalSearch::COORDINATE)
+            return 2 * p.dims;
+
+        if (isLbfgs(p))
+            return std::max(p.dims, int(lineSteps));
+
+        return 0;
+    }
+
+    // Improves x in place within budget evaluations, returns true when x
+    // changed. f and viol must hold the evaluation of x.
+    template <typename EVAL>
+    bool
+    refine(EVAL & eval,
+           vector<Precision> & x,
+           Precision & f,
+           Precision & viol,
+           int const budget)
+    {
+        const long limit = evals + budget;
+
+        if (p.localSearch == CDEEPSOParams::LocalSearch::COORDINATE)
+            return coordinate(eval, x, f, viol, limit);
+
+        if (p.localSearch == CDEEPSOParams::LocalSearch::LBFGS)
+            return lbfgs(eval, x, f, viol, limit);
+
+        return false;
+    }
+
+    template <typename EVAL>
+    bool
+    coordinate(EVAL & eval,
+               vector<Precision> & x,
+               Precision & f,
+               Precision & viol,
+               long const limit)
+    {
+        const int dims = p.dims;
+        bool changed = false;
+
+        for (int j=0;j!=dims;++j)
+            steps[j] = 0.1 * (xMax[j] - xMin[j]);
+
+        while (evals + 2 * dims <= limit)
+        {
+            int n = 0;
+
+            for (int j=0;j!=dims;++j)
+            {
+                if (fixed[j])
+                    continue;
+
+                for (int sign=-1;sign<=1;sign+=2)
+                {
+                    std::copy(x.begin(), x.end(), &rows(n,0));
+                    rows(n,j) = clamp(x[j] + sign * steps[j], j);
+                    ++n;
+                }
+            }
+
+            if (n == 0)
+                break;
+
+            const int best = evaluateRows(eval, n);
+
+            if (ops::isBetter(fitness[best], violation[best], f, viol))
+            {
+                const int j = movedDim(x, best);
+                rows.exportRow(best, x);
+                f = fitness[best];
+                viol = violation[best];
+                changed = true;
+
+                if (j >= 0)
+                    steps[j] *= 2.0;
+            }
+            else
+            {
+                Precision largest = 0.0;
+
+                for (int j=0;j!=dims;++j)
+                {
+                    steps[j] *= 0.5;
+                    largest = std::max(largest, steps[j] / (xMax[j] - xMin[j]));
+                }
+
+                if (largest < 1e-12)
+                    break;
+            }
+        }
+
+        return changed;
+    }
+
+    template <typename EVAL>
+    bool
+    lbfgs(EVAL & eval,
+          vector<Precision> & x,
+          Precision & f,
+          Precision & viol,
+          long const limit)
+    {
+        const int dims = p.dims;
+        int stored = 0;
+        int newest = -1;
+        bool changed = false;
+
+        if (!gradient(eval, x, f, limit))
+            return false;
+
+        while (evals + lineSteps <= limit)
+        {
+            // Two loop recursion, dir = -H grad
+            for (int j=0;j!=dims;++j)
+                dir[j] = -grad[j];
+
+            for (int k=0;k!=stored;++k)
+            {
+                const int m = (newest - k + lbfgsMemory) % lbfgsMemory;
+                alpha[m] = rho[m] * dot(s[m], dir);
+                axpy(-alpha[m], y[m], dir);
+            }
+
+            if (stored)
+            {
+                const Precision gamma = dot(s[newest], y[newest]) / dot(y[newest], y[newest]);
+                for (int j=0;j!=dims;++j)
+                    dir[j] *= gamma;
+            }
+            else
+            {
+                // First step moves at most 10% of the smallest range
+                Precision range = xMax[0] - xMin[0];
+                for (int j=1;j!=dims;++j)
+                    range = std::min(range, xMax[j] - xMin[j]);
+
+                const Precision norm = std::sqrt(dot(dir, dir));
+                if (norm > 0.0)
+                    for (int j=0;j!=dims;++j)
+                        dir[j] *= 0.1 * range / norm;
+            }
+
+            for (int k=stored-1;k>=0;--k)
+            {
+                const int m = (newest - k + lbfgsMemory) % lbfgsMemory;
+                const Precision beta = rho[m] * dot(y[m], dir);
+                axpy(alpha[m] - beta, s[m], dir);
+            }
+
+            for (int j=0;j!=dims;++j)
+                if (fixed[j])
+                    dir[j] = 0.0;
+
+            const Precision slope = dot(grad, dir);
+
+            if (!(slope < 0.0))
+            {
+                if (!stored)
+                    break;
+
+                stored = 0;
+                continue;
+            }
+
+            // Step lengths 1, 1/4, 1/16, ... in one batch
+            Precision step = 1.0;
+            for (int r=0;r!=lineSteps;++r,step*=0.25)
+                for (int j=0;j!=dims;++j)
+                    rows(r,j) = clamp(x[j] + step * dir[j], j);
+
+            const int best = evaluateRows(eval, lineSteps);
+
+            if (!ops::isBetter(fitness[best], violation[best], f, viol))
+            {
+                if (!stored)
+                    break;
+
+                stored = 0;
+                continue;
+            }
+
+            newest = (newest + 1) % lbfgsMemory;
+            stored = std::min(stored + 1, lbfgsMemory);
+
+            for (int j=0;j!=dims;++j)
+            {
+                s[newest][j] = rows(best,j) - x[j];
+                y[newest][j] = -grad[j];
+            }
+
+            rows.exportRow(best, x);
+            f = fitness[best];
+            viol = violation[best];
+            changed = true;
+
+            if (!gradient(eval, x, f, limit))
+                break;
+
+            axpy(1.0, grad, y[newest]);
+            const Precision sy = dot(s[newest], y[newest]);
+
+            // Keep the Hessian estimate positive definite
+            if (sy <= 1e-16)
+                stored = 0;
+            else
+                rho[newest] = 1.0 / sy;
+        }
+
+        return changed;
+    }
+
+    // Forward differences, backward next to the upper bound
+    template <typename EVAL>
+    bool
+    gradient(EVAL & eval,
+             vector<Precision> const & x,
+             Precision const f,
+             long const limit)
+    {
+        const int dims = p.dims;
+
+        if (evals + dims > limit)
+            return false;
+
+        for (int j=0;j!=dims;++j)
+        {
+            std::copy(x.begin(), x.end(), &rows(j,0));
+
+            const Precision h = 1.5e-8 * std::max(std::abs(x[j]), Precision(1.0));
+            if (!fixed[j])
+                rows(j,j) = x[j] + h <= xMax[j] ? x[j] + h : x[j] - h;
+        }
+
+        evaluateRows(eval, dims);
+
+        for (int j=0;j!=dims;++j)
+        {
+            const Precision h = rows(j,j) - x[j];
+            grad[j] = fixed[j] || h == 0.0 ? 0.0 : (fitness[j] - f) / h;
+        }
+
+        return true;
+    }
+
+    // Evaluates the first n rows, returns the best of them
+    template <typename EVAL>
+    int
+    evaluateRows(EVAL & eval,
+                 int const n)
+    {
+        for (uint i=0;i!=refresh.size();++i)
+            refresh[i] = int(i) < n;
+
+        evaluate(eval, rows, refresh, fitness, violation);
+
+        for (uint i=0;i!=refresh.size();++i)
+            if (refresh[i])
+                ++evals;
+
+        int best = 0;
+        for (int i=1;i<n;++i)
+            if (ops::isBetter(fitness[i], violation[i], fitness[best], violation[best]))
+                best = i;
+
+        return best;
+    }
+
+    int
+    movedDim(vector<Precision> const & x,
+             int const row) const
+    {
+        for (int j=0;j!=p.dims;++j)
+            if (rows(row,j) != x[j])
+                return j;
+        return -1;
+    }
+
+    Precision
+    clamp(Precision const v,
+          int const j) const
+    {
+        return v < xMin[j] ? xMin[j] : v > xMax[j] ? xMax[j] : v;
+    }
+
+    static Precision
+    dot(vector<Precision> const & a,
+        vector<Precision> const & b)
+    {
+        Precision sum = 0.0;
+        for (uint j=0;j!=a.size();++j)
+            sum += a[j] * b[j];
+        return sum;
+    }
+
+    static void
+    axpy(Precision const a,
+         vector<Precision> const & x,
+         vector<Precision> & y)
+    {
+        for (uint j=0;j!=x.size();++j)
+            y[j] += a * x[j];
+    }
+};
+
+#endif // LOCAL_HPP
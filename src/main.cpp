@@ -1,10 +1,24 @@
+#include "batch.hpp"
+#include "ccdeepso.hpp"
 #include "cdeepso.hpp"
 #include "cdeepso_params.hpp"
+#include "elite.hpp"
+#include "experiment.hpp"
 #include "functions.hpp"
+#include "mocdeepso.hpp"
+#include "noise.hpp"
+#include "numa.hpp"
+#include "planner.hpp"
+#include "race.hpp"
+#include "rotated.hpp"
+#include "shared.hpp"
+#include "trace.hpp"
+#include "traffic.hpp"
 
 #include <iostream>
 #include <wup/wup.hpp>
 #include <sstream>
+#include <algorithm>
 
 WUP_STATICS;
 
@@ -21,6 +35,278 @@ custom(Population & pop,
             fitness[i] = rosenbrock(&pop.particles(i,0), pop.particles.numCols());
 }
 
+typedef void (*MultiEvalFunction)(Particles & particles,
+                                  Refreshes & refresh,
+                                  ObjectiveVectors & objectives);
+
+typedef void (*ConstraintFunction)(Particles & particles,
+                                   Refreshes & refresh,
+                                   Violations & violation);
+
+// Functions selected by the eval and constraint params
+class Problem
+{
+public:
+    EvalFunction eval = nullptr;
+    MultiEvalFunction moEval = nullptr;
+    Objective objective;
+    ConstraintFunction constraint = nullptr;
+
+    // Shifted and rotated benchmarks, the transform is shared by all runs
+    std::shared_ptr<ShiftRotation> transform;
+    Objective::Function rotated = nullptr;
+    Precision rotatedOffset = 0.0;
+
+    Problem(CDEEPSOParams const & cp)
+    {
+        if (cp.eval == "zdt1") moEval = zdt1;
+        else if (cp.eval == "zdt2") moEval = zdt2;
+        else if (findRotated(cp.eval, rotated, rotatedOffset)) transform.reset(new ShiftRotation(cp));
+        else eval = findEval(cp.eval);
+
+        if (moEval)
+            checkZdtBounds(cp);
+
+        if (eval)
+            objective = findObjective(cp.eval);
+
+        if (cp.constraint == "sum") constraint = sumConstraint;
+        else if (cp.constraint != "none") error("Invalid constraint:", cp.constraint);
+    }
+
+    // ZDT functions are only defined on [0,1] and need a second dimension for g
+    static void
+    checkZdtBounds(CDEEPSOParams const & cp)
+    {
+        if (cp.dims < 2)
+            error("ZDT functions need at least 2 dims");
+
+        bool inside = cp.xMin >= 0.0 && cp.xMax <= 1.0;
+
+        if (!cp.dimMin.empty())
+        {
+            inside = true;
+            for (uint j=0;j!=cp.dimMin.size();++j)
+                inside = inside && cp.dimMin[j] >= 0.0 && cp.dimMax[j] <= 1.0;
+        }
+
+        if (!inside)
+            error("ZDT functions are defined on [0,1], e.g. -xMin 0 -xMax 1");
+    }
+
+    // Identity of the objective for the shared archive, the shifted and
+    // rotated benchmarks include their transform
+    std::string
+    tag(CDEEPSOParams const & cp) const
+    {
+        if (transform)
+            return cat(cp.eval, "/", cp.constraint, "/", transform->fingerprint());
+        return cat(cp.eval, "/", cp.constraint);
+    }
+};
+
+class RunResult
+{
+public:
+    Precision gBestFit;
+    Precision gBestViolation;
+    int fitEval;
+    EliteSet elite;
+};
+
+// Routes the evaluations through the shared archive cache when there is one
+// and splits every batch among the team when it has more than one member
+class OptimizeWith
+{
+public:
+    CDEEPSO & m;
+    SharedArchive * shared;
+    EvalTeam * team;
+
+    template <typename EVAL>
+    void
+    operator()(EVAL eval) const
+    {
+        if (shared) withTeam(sharedCached(eval, *shared));
+        else withTeam(eval);
+    }
+
+    template <typename EVAL>
+    void
+    withTeam(EVAL eval) const
+    {
+        if (team) m.optimize(inTeam(eval, *team));
+        else m.optimize(eval);
+    }
+};
+
+// Passes the evaluator to f with gaussian noise of deviation sigma on its fitness
+template <typename F>
+class WithNoise
+{
+public:
+    F f;
+    Precision sigma;
+    uint64_t seed;
+
+    template <typename EVAL>
+    void
+    operator()(EVAL eval) const
+    {
+        f(noisy(eval, sigma, seed));
+    }
+};
+
+// Calls f with the evaluator selected by the eval, constraint and deltaEval
+// params
+template <typename F>
+void
+withCleanEvaluator(CDEEPSOParams const & cp,
+                   Problem const & problem,
+                   F f)
+{
+    EvalFunction eval = problem.eval;
+    ConstraintFunction constraint = problem.constraint;
+
+    if (problem.transform)
+    {
+        if (cp.deltaEval)
+            error("No incremental evaluator for:", cp.eval);
+
+        RotatedEval rotated(*problem.transform, problem.rotated, problem.rotatedOffset);
+
+        if (constraint) f(constrained(rotated, constraint));
+        else f(rotated);
+    }
+    else if (constraint)
+    {
+        if (cp.deltaEval)
+            error("Incremental evaluators are not supported with constraints");
+
+        f(constrained(eval, constraint));
+    }
+    else if (!cp.deltaEval) f(eval);
+    else if (cp.noiseSigma > 0.0 || cp.noiseSamples > 1) error("Incremental evaluators are exact, no noise handling");
+    else if (cp.eval == "ras") f(DeltaEvaluator<RastriginKernel>(cp.popCapacity(), cp.dims, cp.outOfCore));
+    else if (cp.eval == "ros") f(DeltaEvaluator<RosenbrockKernel>(cp.popCapacity(), cp.dims, cp.outOfCore));
+    else if (cp.eval == "gri") f(DeltaEvaluator<GriewankKernel>(cp.popCapacity(), cp.dims, cp.outOfCore));
+    else error("No incremental evaluator for:", cp.eval);
+}
+
+// Same as withCleanEvaluator, plus the benchmark noise of noiseSigma
+template <typename F>
+void
+withEvaluator(CDEEPSOParams const & cp,
+              Problem const & problem,
+              F f)
+{
+    if (cp.noiseSigma > 0.0)
+        withCleanEvaluator(cp, problem, WithNoise<F>{f, cp.noiseSigma, uint64_t(cp.seed)});
+    else
+        withCleanEvaluator(cp, problem, f);
+}
+
+class CalibrateWith
+{
+public:
+    ParallelPlan & plan;
+    CDEEPSOParams const & cp;
+
+    template <typename EVAL>
+    void
+    operator()(EVAL eval) const
+    {
+        plan.calibrate(cp, eval);
+    }
+};
+
+class MeasureTraffic
+{
+public:
+    TrafficBenchmark & bench;
+
+    template <typename EVAL>
+    void
+    operator()(EVAL eval) const
+    {
+        bench.run(eval);
+    }
+};
+
+RunResult
+runOnce(CDEEPSOParams & params,
+        int const run,
+        Problem const & problem,
+        TraceTable * traces,
+        RaceBoard * board,
+        SharedArchive * shared,
+        EvalTeam * team,
+        EliteSet const * warm)
+{
+    // Run r of -seed s is replayed alone with -seed s+r -maxRun 1
+    CDEEPSOParams cp = params;
+    if (params.seed)
+        cp.seed = params.seed + run;
+
+    ConstraintFunction constraint = problem.constraint;
+
+    // Multi-objective runs report the hypervolume of the archive, negated so
+    // that lower is better like the other fitness values
+    if ((problem.moEval || cp.blockSize > 0) && cp.deadline > 0.0)
+        error("Deadlines are only supported by single swarm runs");
+
+    if (problem.moEval)
+    {
+        MOCDEEPSO m(cp, 2);
+        m.optimize(problem.moEval);
+        if (traces) traces->store(run, m.trace);
+        return RunResult{-m.archive.hypervolume(cp.hvRef, cp.hvRef), 0.0, m.fitEval, EliteSet()};
+    }
+
+    if (cp.blockSize > 0)
+    {
+        if (constraint)
+            error("Constraints are not supported in cooperative mode");
+
+        if (problem.transform)
+            error("Rotated functions are not supported in cooperative mode");
+
+        CCDEEPSO m(cp, problem.objective);
+        m.optimize();
+        if (traces) traces->store(run, m.trace);
+        return RunResult{m.gBestFit, 0.0, m.fitEval, EliteSet()};
+    }
+
+    // A run killed by the race restarts with seed + run + attempt * maxRun,
+    // the last attempt of a slot runs until the budget or the target
+    int spent = 0;
+
+    for (int attempt=0;;++attempt)
+    {
+        if (attempt)
+            cp.seed = params.seed ? params.seed + run + attempt * params.maxRun : 0;
+
+        CDEEPSO m(cp);
+
+        if (board)
+            m.setRaceBoard(board, attempt < cp.raceRestarts);
+
+        m.setSharedArchive(shared);
+        m.setWarmStart(warm);
+
+        withEvaluator(cp, problem, OptimizeWith{m, shared, team});
+
+        spent += m.fitEval;
+
+        if (m.killed)
+            continue;
+
+        if (traces) traces->store(run, m.trace);
+
+        return RunResult{m.gBestFit, m.gBestViolation, spent, cp.saveElite.empty() ? EliteSet() : m.elite(cp.eliteSize)};
+    }
+}
+
 int
 main(const int argc, const char * argv[])
 {
@@ -30,36 +316,159 @@ main(const int argc, const char * argv[])
     Params p(argc, argv);
     CDEEPSOParams cp(p);
     vector<Precision> allFits(cp.maxRun);
+    vector<Precision> allViolations(cp.maxRun);
     vector<long double> ellapsed(cp.maxRun);
+    vector<EliteSet> elites(cp.maxRun);
+
+    cp.display();
 
-    void (*eval)(Particles & particles,
-                 Refreshes & refresh,
-                 Fitness & fitness) = nullptr;
+    if (!cp.batch.empty())
+    {
+        Clock cb;
+        Batch batch(cp);
+        batch.load(cp.batch);
 
-    if (cp.eval == "ras") eval = rastrigin;
-    else if (cp.eval == "ros") eval = rosenbrock;
-    else if (cp.eval == "gri") eval = griewank;
-    else error("Invalid eval function:", cp.eval);
+        // Resolved once per job, so bad names fail before any run starts
+        vector<Problem> problems(batch.jobs.begin(), batch.jobs.end());
 
-    cp.display();
+        print(YELLOW, "\n--- CDEEPSO++ Batch ---\n", NORMAL);
+        batch.run(cp.batchOut, [&](int const job, CDEEPSOParams & jp, int const run) {
+            return runOnce(jp, run, problems[job], nullptr, nullptr, nullptr, nullptr, nullptr);
+        });
+
+        print("Jobs:", batch.jobs.size(), ", runs:", batch.tasks.size(), ", total time:", cb.stop().ellapsed_milli(), "ms, results in", cp.batchOut);
+        return 0;
+    }
+
+    Problem problem(cp);
+
+    if (cp.trafficBench > 0)
+    {
+        if (problem.moEval || cp.blockSize > 0)
+            error("The traffic benchmark only runs single swarms");
+
+        TrafficBenchmark bench(cp);
+
+        print(YELLOW, "\n--- CDEEPSO++ Traffic ---\n", NORMAL);
+        withEvaluator(cp, problem, MeasureTraffic{bench});
+        bench.display();
+        return 0;
+    }
+
+    if (!cp.experiment.empty())
+    {
+        Clock ce;
+        Experiment experiment(cp);
+
+        print(YELLOW, "\n--- CDEEPSO++ Experiment ---\n", NORMAL);
+        experiment.run();
+        experiment.write(cp.experiment);
+
+        print("Jobs:", experiment.jobs.size(), ", total time:", ce.stop().ellapsed_milli(), "ms, results in", cp.experiment);
+        return 0;
+    }
 
     Clock cc;
+    std::unique_ptr<NumaPool> pool;
+    std::unique_ptr<TraceTable> traces;
+    std::unique_ptr<RaceBoard> board;
+    std::unique_ptr<SharedArchive> shared;
+
+    if (!cp.traceFile.empty())
+        traces.reset(new TraceTable(cp.maxRun, ConvergenceTrace(cp.tracePoints, cp.popSize, cp.maxFitEval)));
+
+    if (cp.race)
+    {
+        if (problem.moEval || cp.blockSize > 0)
+            error("Racing is only supported by single swarm runs");
+        board.reset(new RaceBoard(cp));
+    }
+
+    if (cp.noiseSamples > 1 && (problem.moEval || cp.blockSize > 0 || !cp.sharedFile.empty()))
+        error("Noise handling is only supported by single swarm runs without a shared archive");
+
+    EliteSet warm;
+
+    if (!cp.loadElite.empty() || !cp.saveElite.empty())
+    {
+        if (problem.moEval || cp.blockSize > 0)
+            error("Warm starts are only supported by single swarm runs");
+
+        if (!cp.loadElite.empty())
+        {
+            warm.load(cp.loadElite);
+            print("Warm start from", warm.entries.size(), "elite solutions of", cp.loadElite);
+        }
+    }
+
+    EliteSet const * const warmStart = warm.empty() ? nullptr : &warm;
+
+    if (!cp.sharedFile.empty())
+    {
+        if (problem.moEval || cp.blockSize > 0)
+            error("The shared archive is only supported by single swarm runs");
+
+        if (cp.noiseSigma > 0.0)
+            error("The shared archive caches exact fitness values, no benchmark noise");
+
+        shared.reset(new SharedArchive(cp.sharedFile, cp.dims, cp.sharedTop, cp.sharedCache, problem.tag(cp)));
+    }
 
     print(YELLOW, "\n--- CDEEPSO++ Main Loop ---\n", NORMAL);
 
-    if (cp.threads == 1)
+    if (cp.numa)
+    {
+        // Each run is built inside its pinned worker, so its populations are
+        // first touched and allocated on the worker's node
+        pool.reset(new NumaPool(cp.threads));
+        pool->run(cp.maxRun, [&](const int tid, const int jid) {
+            UNUSED(tid);
+
+            Clock c;
+
+            RunResult result = runOnce(cp, jid, problem, traces.get(), board.get(), shared.get(), nullptr, warmStart);
+            allFits[jid] = result.gBestFit;
+            allViolations[jid] = result.gBestViolation;
+            elites[jid] = result.elite;
+            ellapsed[jid] = c.stop().ellapsed_milli();
+
+            return long(result.fitEval);
+        });
+    }
+
+    else if (cp.planner)
+    {
+        // Cooperative and multi-objective runs only parallelize across runs
+        ParallelPlan plan(cp);
+
+        if (!problem.moEval && cp.blockSize == 0)
+            withEvaluator(cp, problem, CalibrateWith{plan, cp});
+
+        plan.display();
+
+        plan.execute(cp.popCapacity(), [&](const int jid, EvalTeam & team) {
+            Clock c;
+
+            RunResult result = runOnce(cp, jid, problem, traces.get(), board.get(), shared.get(), &team, warmStart);
+            allFits[jid] = result.gBestFit;
+            allViolations[jid] = result.gBestViolation;
+            elites[jid] = result.elite;
+            ellapsed[jid] = c.stop().ellapsed_milli();
+        });
+    }
+
+    else if (cp.threads == 1)
     {
         Clock c;
         for (int r=0;r!=cp.maxRun;++r)
         {
             c.start();
-            CDEEPSO m(cp);
-
-            m.optimize(eval);
 
+            RunResult result = runOnce(cp, r, problem, traces.get(), board.get(), shared.get(), nullptr, warmStart);
+            allFits[r] = result.gBestFit;
+            allViolations[r] = result.gBestViolation;
+            elites[r] = result.elite;
             ellapsed[r] = c.lap_milli();
-            allFits[r] = m.gBestFit;
-//            printn(cat(WHITE, r, NORMAL, " : Best fitness = ", GREEN, m.gBestFit, "\n", NORMAL));
         }
     }
 
@@ -69,13 +478,12 @@ main(const int argc, const char * argv[])
             UNUSED(tid);
 
             Clock c;
-            CDEEPSO m(cp);
-
-            m.optimize(eval);
 
+            RunResult result = runOnce(cp, jid, problem, traces.get(), board.get(), shared.get(), nullptr, warmStart);
+            allFits[jid] = result.gBestFit;
+            allViolations[jid] = result.gBestViolation;
+            elites[jid] = result.elite;
             ellapsed[jid] = c.stop().ellapsed_milli();
-            allFits[jid] = m.gBestFit;
-//            printn(cat(WHITE, jid, NORMAL, " : Best fitness = ", GREEN, m.gBestFit, "\n", NORMAL));
         });
     }
 
@@ -91,6 +499,24 @@ main(const int argc, const char * argv[])
     print("  Mean:", mean);
     print("  Std:", std);
 
+    if (problem.constraint)
+        print("Feasible runs:", std::count(allViolations.begin(), allViolations.end(), 0.0), "/", cp.maxRun);
+
+    if (board)
+    {
+        print("Race:");
+        print("  Leader:", board->best.load());
+        print("  Target reached:", board->isFinished() ? "yes" : "no");
+        print("  Killed runs:", board->kills.load());
+    }
+
+    if (shared)
+    {
+        print("Shared archive:");
+        print("  Cache hits:", shared->cacheHits.load());
+        print("  Cache misses:", shared->cacheMisses.load());
+    }
+
     print("Total execution time:", totalTime, "ms");
 
     arr::stats(ellapsed, minimum, maximum, mean, std);
@@ -101,5 +527,25 @@ main(const int argc, const char * argv[])
     print("  Std:", std, "ms");
     printn(NORMAL);
 
+    if (pool)
+        pool->display(totalTime);
+
+    if (traces)
+    {
+        traces->write(cp.traceFile);
+        print("Convergence traces written to", cp.traceFile);
+    }
+
+    // The best solutions of all runs, for the next run of the job
+    if (!cp.saveElite.empty())
+    {
+        EliteSet best(cp.dims);
+        for (auto & e : elites)
+            best.merge(e);
+        best.keepBest(cp.eliteSize);
+        best.save(cp.saveElite);
+        print("Elite set written to", cp.saveElite);
+    }
+
     return 0;
 }
@@ -0,0 +1,172 @@
+#ifndef MATRIX_HPP
+#define MATRIX_HPP
+
+#include <wup/wup.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace wup;
+
+// Row-major matrix with the Bundle interface used for particles and
+// velocities. The cells live on the heap or, out of core, in a memory mapped
+// file created in a directory and unlinked at once. Mapped cells are paged in
+// and out by the kernel, so a swarm larger than RAM only keeps the pages of
+// the rows being processed resident, and the mapping is marked sequential
+// since every ops:: pass walks the rows in order. A copy of a mapped matrix
+// is mapped in the same directory.
+template <typename T>
+class Matrix
+{
+public:
+
+    T * cells;
+    size_t rows;
+    size_t cols;
+    size_t bytes;
+    bool mapped;
+    std::string directory;
+
+public:
+
+    Matrix() :
+        cells(nullptr),
+        rows(0),
+        cols(0),
+        bytes(0),
+        mapped(false)
+    {
+
+    }
+
+    // An empty directory keeps the cells on the heap
+    Matrix(size_t const rows,
+           size_t const cols,
+           T const value,
+           std::string const & directory="") :
+        cells(nullptr),
+        rows(rows),
+        cols(cols),
+        bytes(rows * cols * sizeof(T)),
+        mapped(!directory.empty()),
+        directory(directory)
+    {
+        if (mapped)
+            map(directory);
+        else
+            cells = new T[rows * cols];
+
+        std::fill(cells, cells + rows * cols, value);
+    }
+
+    Matrix(Matrix const & other) :
+        cells(nullptr),
+        rows(other.rows),
+        cols(other.cols),
+        bytes(other.bytes),
+        mapped(other.mapped),
+        directory(other.directory)
+    {
+        if (mapped)
+            map(directory);
+        else
+            cells = new T[rows * cols];
+
+        std::copy(other.begin(), other.end(), cells);
+    }
+
+    Matrix &
+    operator=(Matrix other)
+    {
+        std::swap(cells, other.cells);
+        std::swap(rows, other.rows);
+        std::swap(cols, other.cols);
+        std::swap(bytes, other.bytes);
+        std::swap(mapped, other.mapped);
+        std::swap(directory, other.directory);
+        return *this;
+    }
+
+    ~Matrix()
+    {
+        if (mapped)
+            munmap(cells, std::max(bytes, size_t(1)));
+        else
+            delete [] cells;
+    }
+
+    size_t numRows() const { return rows; }
+    size_t numCols() const { return cols; }
+
+    T & operator()(size_t const i, size_t const j) { return cells[i * cols + j]; }
+    T const & operator()(size_t const i, size_t const j) const { return cells[i * cols + j]; }
+
+    T * begin() { return cells; }
+    T * end() { return cells + rows * cols; }
+    T const * begin() const { return cells; }
+    T const * end() const { return cells + rows * cols; }
+
+    void
+    importRow(Matrix const & other,
+              size_t const src,
+              size_t const dst)
+    {
+        std::copy(&other(src,0), &other(src,0) + cols, &(*this)(dst,0));
+    }
+
+    void
+    exportRow(size_t const src,
+              std::vector<T> & dst) const
+    {
+        std::copy(&(*this)(src,0), &(*this)(src,0) + cols, dst.begin());
+    }
+
+    // Drops the resident pages of rows [first, last) that were already
+    // processed, their contents stay in the file. No-op on the heap.
+    void
+    release(size_t const first,
+            size_t const last)
+    {
+        if (!mapped || first >= last)
+            return;
+
+        const size_t page = sysconf(_SC_PAGESIZE);
+        const size_t begin = (first * cols * sizeof(T) + page - 1) / page * page;
+        const size_t end = std::min(bytes, last * cols * sizeof(T)) / page * page;
+
+        if (begin < end)
+            madvise(reinterpret_cast<char*>(cells) + begin, end - begin, MADV_DONTNEED);
+    }
+
+private:
+
+    void
+    map(std::string const & directory)
+    {
+        std::string path = directory + "/cdeepso-XXXXXX";
+        const int fd = mkstemp(&path[0]);
+
+        if (fd < 0)
+            error("Could not create out of core storage in:", directory);
+
+        unlink(path.c_str());
+
+        if (ftruncate(fd, std::max(bytes, size_t(1))) != 0)
+            error("Could not size out of core storage in:", directory);
+
+        void * const mem = mmap(nullptr, std::max(bytes, size_t(1)), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+
+        if (mem == MAP_FAILED)
+            error("Could not map out of core storage in:", directory);
+
+        madvise(mem, bytes, MADV_SEQUENTIAL);
+        cells = static_cast<T*>(mem);
+    }
+};
+
+#endif // MATRIX_HPP
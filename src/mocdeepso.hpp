@@ -0,0 +1,281 @@
+#ifndef MOCDEEPSO_HPP
+#define MOCDEEPSO_HPP
+
+#include "cdeepso_params.hpp"
+#include "init.hpp"
+#include "operations.hpp"
+#include "pareto.hpp"
+#include "population.hpp"
+#include "trace.hpp"
+
+#include <future>
+
+// Multi-objective C-DEEPSO. Fitness is a vector of numObjs objectives, all
+// minimized, and the global memory is a bounded Pareto archive. The guides of
+// the DE step and of the PSO cooperation term are sampled from the archive per
+// particle. Selections use Pareto dominance and, when two solutions do not
+// dominate each other, a fair coin.
+//
+// The evaluator has the signature
+//     void eval(Particles & particles, Refreshes & refresh, ObjectiveVectors & objectives)
+// and writes one row of numObjs objectives per refreshed particle.
+class MOCDEEPSO
+{
+public:
+
+    CDEEPSOParams & p;
+    int numObjs;
+
+    vector<double> xMin;
+    vector<double> xMax;
+    vector<double> vMin;
+    vector<double> vMax;
+
+    Population pop1;
+    Population myBest;
+    Population pop2;
+    ObjectiveVectors pop1Objs;
+    ObjectiveVectors pop2Objs;
+    ObjectiveVectors myBestObjs;
+    Refreshes pop1Refresh;
+    Refreshes pop2Refresh;
+    Particles guides;
+
+    ParetoArchive archive;
+    int fitEval;
+
+    ConvergenceTrace trace;
+    Random generator;
+
+public:
+
+    MOCDEEPSO(CDEEPSOParams & p, int const numObjs) :
+        p(p),
+        numObjs(numObjs),
+
+        xMin(p.dims),
+        xMax(p.dims),
+        vMin(p.dims),
+        vMax(p.dims),
+
+        pop1(p.popSize, p.dims),
+        myBest(p.popSize, p.dims),
+        pop2(p.popSize, p.dims),
+        pop1Objs(p.popSize, numObjs, 0),
+        pop2Objs(p.popSize, numObjs, 0),
+        myBestObjs(p.popSize, numObjs, 0),
+        pop1Refresh(p.popSize),
+        pop2Refresh(p.popSize),
+        guides(p.popSize, p.dims, 0),
+
+        archive(p.dims, numObjs, p.archiveSize),
+        fitEval(0),
+
+        trace(p.tracePoints, p.popSize, p.maxFitEval),
+        generator(p.seed)
+    {
+        ops::initLimits(p, xMin, xMax, vMin, vMax);
+    }
+
+    template <typename EVAL>
+    void
+    computeFitness(Population & pop,
+                   Refreshes & refresh,
+                   ObjectiveVectors & objs,
+                   EVAL & eval)
+    {
+        eval(pop.particles, refresh, objs);
+        recordFitness(pop, refresh, objs);
+    }
+
+    // Adds the refreshed particles to the archive and counts them
+    void
+    recordFitness(Population & pop,
+                  Refreshes & refresh,
+                  ObjectiveVectors & objs)
+    {
+        for (uint i=0;i!=pop.size();++i)
+        {
+            if (refresh[i])
+            {
+                archive.insert(&pop.particles(i,0), &objs(i,0), pop.weights[i]);
+                fitEval += 1;
+                refresh[i] = false;
+            }
+        }
+    }
+
+    bool
+    replaces(ObjectiveVectors const & srcObjs,
+             ObjectiveVectors const & dstObjs,
+             int const i)
+    {
+        if (ParetoArchive::dominates(&srcObjs(i,0), &dstObjs(i,0), numObjs))
+            return true;
+
+        if (ParetoArchive::dominates(&dstObjs(i,0), &srcObjs(i,0), numObjs))
+            return false;
+
+        return generator.unfairCoin(0.5);
+    }
+
+    void
+    select(Population const & src,
+           ObjectiveVectors const & srcObjs,
+           Population & dst,
+           ObjectiveVectors & dstObjs,
+           bool const withVelocity)
+    {
+        for (uint i=0;i!=src.size();++i)
+        {
+            if (replaces(srcObjs, dstObjs, i))
+            {
+                dst.particles.importRow(src.particles, i, i);
+                if (withVelocity)
+                    dst.velocity.importRow(src.velocity, i, i);
+                dst.weights[i] = src.weights[i];
+                dstObjs.importRow(srcObjs, i, i);
+            }
+        }
+    }
+
+    void
+    sampleGuides()
+    {
+        for (uint i=0;i!=pop1.size();++i)
+        {
+            Precision const * const g = archive.position(archive.sample(generator));
+            std::copy(g, g + p.dims, &guides(i,0));
+        }
+    }
+
+    // DE step of heuristicBest with archive members as gBest and differences
+    void
+    createPop2FromHeuristic()
+    {
+        for (uint i=0;i!=pop1.size();++i)
+        {
+            Precision const * const g = &guides(i,0);
+            Precision const * const m1 = archive.position(archive.sample(generator));
+            Precision const * const m2 = archive.position(archive.sample(generator));
+
+            Weight const & w = pop1.weights[i];
+            Precision * const d = &pop2.particles(i,0);
+            pop2.weights[i] = w;
+            pop2.velocity.importRow(pop1.velocity, i, i);
+
+            for (int j=0;j!=p.dims;++j)
+                d[j] = g[j] + w.dVelocity * (m1[j] - m2[j]);
+
+            const int tmpIndexD = generator.uniformInt(p.dims);
+
+            for (int j=0;j!=p.dims;++j)
+                if (generator.unfairCoin(w.dThreshold) || j == tmpIndexD)
+                    d[j] = g[j];
+        }
+
+        ops::enforceLimits(pop2, &pop1, xMin, xMax, vMin, vMax, p.intDims, p.boundStrategy, generator);
+    }
+
+    template <typename EVAL>
+    void
+    start(EVAL & eval)
+    {
+        ops::initPopulation(pop1, generator, xMin, xMax, vMin, vMax, p.maxVelocity);
+        ops::initPositions(pop1, p.initStrategy, generator, xMin, xMax);
+        ops::enforceLimits(pop1, nullptr, xMin, xMax, vMin, vMax, p.intDims, p.boundStrategy, generator);
+
+        std::fill(pop1Refresh.begin(), pop1Refresh.end(), true);
+        computeFitness(pop1, pop1Refresh, pop1Objs, eval);
+
+        myBest.cloneFrom(pop1);
+        for (uint i=0;i!=pop1.size();++i)
+            myBestObjs.importRow(pop1Objs, i, i);
+        archive.truncate();
+    }
+
+    template <typename EVAL>
+    void
+    step(EVAL & eval)
+    {
+        sampleGuides();
+        createPop2FromHeuristic();
+        std::fill(pop2Refresh.begin(), pop2Refresh.end(), true);
+        computeFitness(pop2, pop2Refresh, pop2Objs, eval);
+        select(pop2, pop2Objs, pop1, pop1Objs, false);
+
+        pop2.cloneFrom(pop1);
+        ops::computeNewWeights(pop1, pop2, p.mutationRate, p.maxVelocity);
+        ops::computeNewVel(pop2, generator, myBest, guides, vMin, vMax, p.communicationProbability);
+        ops::computeNewPos(pop2);
+        ops::enforceLimits(pop2, &pop1, xMin, xMax, vMin, vMax, p.intDims, p.boundStrategy, generator);
+        std::fill(pop2Refresh.begin(), pop2Refresh.end(), true);
+
+        // Same overlap as in CDEEPSO::step, pop2 enters the archive only
+        // after the evaluation, before pop1 does, as in the sequential order
+        std::future<void> pending;
+        if (p.pipeline)
+            pending = std::async(std::launch::async, [&]() {
+                eval(pop2.particles, pop2Refresh, pop2Objs);
+            });
+        else
+            computeFitness(pop2, pop2Refresh, pop2Objs, eval);
+
+        ops::computeNewVel(pop1, generator, myBest, guides, vMin, vMax, p.communicationProbability);
+        ops::computeNewPos(pop1);
+        ops::enforceLimits(pop1, nullptr, xMin, xMax, vMin, vMax, p.intDims, p.boundStrategy, generator);
+        std::fill(pop1Refresh.begin(), pop1Refresh.end(), true);
+
+        if (p.pipeline)
+        {
+            pending.get();
+            recordFitness(pop2, pop2Refresh, pop2Objs);
+        }
+
+        computeFitness(pop1, pop1Refresh, pop1Objs, eval);
+
+        select(pop2, pop2Objs, pop1, pop1Objs, true);
+        select(pop1, pop1Objs, myBest, myBestObjs, true);
+
+        archive.truncate();
+    }
+
+    // Negated like the fitness reported by main, so lower is better
+    Precision
+    hypervolume() const
+    {
+        return numObjs == 2 ? archive.hypervolume(p.hvRef, p.hvRef) : 0.0;
+    }
+
+    void
+    recordTrace()
+    {
+        if (trace.due(fitEval))
+            trace.record(fitEval, -hypervolume());
+    }
+
+    template <typename EVAL>
+    void
+    optimize(EVAL eval)
+    {
+        int i;
+
+        start(eval);
+        recordTrace();
+
+        for (i=0;i!=p.maxGen && fitEval<=p.maxFitEval;++i)
+        {
+            step(eval);
+            recordTrace();
+
+            if (p.printConvergenceResults != 0 && i % p.printConvergenceResults == 0)
+                printn(BLUE, "Gen: ", i, ", Archive: ", archive.size(), ", fitEvals:" , fitEval, "/", p.maxFitEval, "\n", NORMAL);
+        }
+
+        trace.finish(-hypervolume());
+        printn(YELLOW, "Optimization has ended, Generations: ", i, ", Archive: ", archive.size(), ", Fit Evals:" , fitEval, "/", p.maxFitEval, "\n", NORMAL);
+    }
+
+};
+
+#endif // MOCDEEPSO_HPP
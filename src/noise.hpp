@@ -0,0 +1,462 @@
+#ifndef NOISE_HPP
+#define NOISE_HPP
+
+#include "constraints.hpp"
+#include "operations.hpp"
+#include "population.hpp"
+
+#include <cmath>
+#include <limits>
+
+// Racing of noisy comparisons. Every solution kept by the swarm, the personal
+// bests, the memory and gBest, carries the number of samples behind its
+// fitness, which is their mean, and their sum of squared deviations (Welford).
+// Before a comparison decides what is kept, the pair is contested while the
+// difference of the means is below noiseZ standard errors. A contested pair
+// gets one more sample on the side whose standard error would shrink the most
+// (the two design case of optimal computing budget allocation), and all the
+// samples of a round form one batch of the regular evaluate(). Rounds go on
+// until every pair is decided or its solutions reached noiseSamples samples.
+//
+// The variance of a solution is shrunk towards the variance pooled over all
+// the resampled solutions, so a solution with one or two samples still gets a
+// usable estimate. Violations are assumed to be exact, only feasible pairs
+// are contested.
+class NoiseRacer
+{
+public:
+
+    static const int priorSamples = 2;
+
+    CDEEPSOParams const & p;
+
+    // Candidates of the current race, the rows of pop1
+    vector<int> popCount;
+    vector<Precision> popM2;
+
+    vector<int> bestCount;
+    vector<Precision> bestM2;
+
+    vector<int> memCount;
+    vector<Precision> memM2;
+
+    int gBestCount;
+    Precision gBestM2;
+    int gBestMem;
+
+    Precision pooledM2;
+    long pooledSamples;
+
+    Particles rows;
+    Refreshes refresh;
+    Fitness fitness;
+    Violations violation;
+    vector<Precision*> mean;
+    vector<int*> count;
+    vector<Precision*> m2;
+
+    long resamples;
+    long contests;
+
+public:
+
+    NoiseRacer(CDEEPSOParams const & p) :
+        p(p),
+        popCount(p.popCapacity(), 1),
+        popM2(p.popCapacity(), 0.0),
+        bestCount(p.popCapacity(), 1),
+        bestM2(p.popCapacity(), 0.0),
+        memCount(p.popSize, 1),
+        memM2(p.popSize, 0.0),
+        gBestCount(1),
+        gBestM2(0.0),
+        gBestMem(-1),
+        pooledM2(0.0),
+        pooledSamples(0),
+        resamples(0),
+        contests(0)
+    {
+
+    }
+
+    bool
+    enabled() const
+    {
+        return p.noiseSamples > 1;
+    }
+
+    // Every solution starts over from the sample it has
+    void
+    reset()
+    {
+        std::fill(popCount.begin(), popCount.end(), 1);
+        std::fill(popM2.begin(), popM2.end(), 0.0);
+        std::fill(bestCount.begin(), bestCount.end(), 1);
+        std::fill(bestM2.begin(), bestM2.end(), 0.0);
+        std::fill(memCount.begin(), memCount.end(), 1);
+        std::fill(memM2.begin(), memM2.end(), 0.0);
+
+        gBestCount = 1;
+        gBestM2 = 0.0;
+        gBestMem = -1;
+    }
+
+    Precision
+    variance(int const n,
+             Precision const m2) const
+    {
+        if (pooledSamples == 0)
+            return std::numeric_limits<Precision>::infinity();
+
+        const Precision pooled = pooledM2 / pooledSamples;
+        return (m2 + priorSamples * pooled) / (n - 1 + priorSamples);
+    }
+
+    bool
+    contested(Precision const fitA, int const nA, Precision const m2A, Precision const violA,
+              Precision const fitB, int const nB, Precision const m2B, Precision const violB) const
+    {
+        if (violA != 0.0 || violB != 0.0)
+            return false;
+
+        if (nA >= p.noiseSamples && nB >= p.noiseSamples)
+            return false;
+
+        const Precision error = std::sqrt(variance(nA, m2A) / nA + variance(nB, m2B) / nB);
+        return !(std::abs(fitA - fitB) > p.noiseZ * error);
+    }
+
+    // True when A should get the next sample of a contested pair
+    bool
+    sampleFirst(int const nA, Precision const m2A,
+                int const nB, Precision const m2B) const
+    {
+        if (nB >= p.noiseSamples)
+            return true;
+
+        if (nA >= p.noiseSamples)
+            return false;
+
+        return variance(nA, m2A) / (nA * (nA + 1.0)) >= variance(nB, m2B) / (nB * (nB + 1.0));
+    }
+
+    // pop1 rows replaced by a pop2 winner in the merge carry the sample of
+    // that winner, so the means that are raced belong to the positions
+    void
+    keepWinners(Fitness const & srcFitness,
+                Violations const & srcViolation,
+                Fitness & dstFitness,
+                Violations & dstViolation) const
+    {
+        for (uint i=0;i!=dstFitness.size();++i)
+        {
+            if (ops::isBetter(srcFitness[i], srcViolation[i], dstFitness[i], dstViolation[i]))
+            {
+                dstFitness[i] = srcFitness[i];
+                dstViolation[i] = srcViolation[i];
+            }
+        }
+    }
+
+    // Races every row of pop against its personal best and then carries the
+    // samples of the rows that win into bestCount and bestM2. Returns the
+    // evaluations spent.
+    template <typename EVAL>
+    int
+    raceMyBests(EVAL & eval,
+                Population const & pop,
+                Fitness & popFitness,
+                Violations const & popViolation,
+                Population const & myBest,
+                Fitness & myBestFitness,
+                Violations const & myBestViolation)
+    {
+        const uint n = pop.size();
+        int spent = 0;
+
+        std::fill(popCount.begin(), popCount.begin() + n, 1);
+        std::fill(popM2.begin(), popM2.begin() + n, 0.0);
+
+        for (int round=0;round!=2*p.noiseSamples;++round)
+        {
+            clear(2 * n);
+
+            for (uint i=0;i!=n;++i)
+            {
+                if (!contested(popFitness[i], popCount[i], popM2[i], popViolation[i],
+                               myBestFitness[i], bestCount[i], bestM2[i], myBestViolation[i]))
+                    continue;
+
+                if (round == 0)
+                    ++contests;
+
+                if (sampleFirst(popCount[i], popM2[i], bestCount[i], bestM2[i]))
+                    request(&pop.particles(i,0), popFitness[i], popCount[i], popM2[i]);
+                else
+                    request(&myBest.particles(i,0), myBestFitness[i], bestCount[i], bestM2[i]);
+            }
+
+            if (mean.empty())
+                break;
+
+            spent += flush(eval);
+        }
+
+        for (uint i=0;i!=n;++i)
+        {
+            if (ops::isBetter(popFitness[i], popViolation[i], myBestFitness[i], myBestViolation[i]))
+            {
+                bestCount[i] = popCount[i];
+                bestM2[i] = popM2[i];
+            }
+        }
+
+        return spent;
+    }
+
+    // Races the best row of pop against gBest and carries the samples of the
+    // winner into gBest and the memory entry that updateGBest will replace.
+    // The memory entry holding gBest follows its mean. Returns the
+    // evaluations spent.
+    template <typename EVAL>
+    int
+    raceGBest(EVAL & eval,
+              Population const & pop,
+              Fitness & popFitness,
+              Violations const & popViolation,
+              vector<Precision> const & gBest,
+              Precision & gBestFit,
+              Precision const gBestViolation,
+              Fitness & memGBestFitness,
+              Violations const & memGBestViolation,
+              int const memGBestIndex)
+    {
+        int c = ops::indexOfBest(popFitness, popViolation);
+        int spent = 0;
+
+        for (int round=0;round!=2*p.noiseSamples;++round)
+        {
+            if (!contested(popFitness[c], popCount[c], popM2[c], popViolation[c],
+                           gBestFit, gBestCount, gBestM2, gBestViolation))
+                break;
+
+            if (round == 0)
+                ++contests;
+
+            clear(1);
+
+            if (sampleFirst(popCount[c], popM2[c], gBestCount, gBestM2))
+                request(&pop.particles(c,0), popFitness[c], popCount[c], popM2[c]);
+            else
+                request(gBest.data(), gBestFit, gBestCount, gBestM2);
+
+            spent += flush(eval);
+        }
+
+        // The new samples may have moved another row ahead, updateGBest takes
+        // that one
+        c = ops::indexOfBest(popFitness, popViolation);
+
+        if (gBestMem != -1)
+        {
+            memGBestFitness[gBestMem] = gBestFit;
+            memCount[gBestMem] = gBestCount;
+            memM2[gBestMem] = gBestM2;
+        }
+
+        if (ops::isBetter(popFitness[c], popViolation[c], gBestFit, gBestViolation))
+        {
+            gBestMem = memGBestIndex == int(memGBestFitness.size())
+                    ? ops::indexOfWorst(memGBestFitness, memGBestViolation)
+                    : memGBestIndex;
+
+            gBestCount = popCount[c];
+            gBestM2 = popM2[c];
+            memCount[gBestMem] = gBestCount;
+            memM2[gBestMem] = gBestM2;
+        }
+
+        return spent;
+    }
+
+    // A memory entry found outside the swarm, e.g., by the local search
+    void
+    insertedIntoMemory(int const dstId,
+                       bool const isGBest)
+    {
+        memCount[dstId] = 1;
+        memM2[dstId] = 0.0;
+
+        if (gBestMem == dstId)
+            gBestMem = -1;
+
+        if (isGBest)
+        {
+            gBestCount = 1;
+            gBestM2 = 0.0;
+            gBestMem = dstId;
+        }
+    }
+
+    void
+    moveBest(uint const src,
+             uint const dst)
+    {
+        bestCount[dst] = bestCount[src];
+        bestM2[dst] = bestM2[src];
+    }
+
+    // Rows [first, last) of pop1 and myBest hold a new particle with one sample
+    void
+    fresh(uint const first,
+          uint const last)
+    {
+        for (uint i=first;i!=last;++i)
+        {
+            popCount[i] = 1;
+            popM2[i] = 0.0;
+            bestCount[i] = 1;
+            bestM2[i] = 0.0;
+        }
+    }
+
+private:
+
+    void
+    clear(uint const n)
+    {
+        if (rows.numRows() < n)
+        {
+            rows = Particles(n, p.dims, 0, p.outOfCore);
+            refresh.assign(n, false);
+            fitness.resize(n);
+            violation.resize(n);
+        }
+
+        mean.clear();
+        count.clear();
+        m2.clear();
+    }
+
+    void
+    request(Precision const * const x,
+            Precision & fit,
+            int & n,
+            Precision & sumSq)
+    {
+        const int r = mean.size();
+
+        std::copy(x, x + p.dims, &rows(r,0));
+        refresh[r] = true;
+        mean.push_back(&fit);
+        count.push_back(&n);
+        m2.push_back(&sumSq);
+    }
+
+    // Evaluates the requested rows and adds every sample to its solution
+    template <typename EVAL>
+    int
+    flush(EVAL & eval)
+    {
+        evaluate(eval, rows, refresh, fitness, violation);
+
+        for (uint r=0;r!=mean.size();++r)
+        {
+            refresh[r] = false;
+
+            const Precision x = fitness[r];
+            const Precision delta = x - *mean[r];
+
+            *count[r] += 1;
+            *mean[r] += delta / *count[r];
+
+            const Precision increment = delta * (x - *mean[r]);
+            *m2[r] += increment;
+
+            pooledM2 += increment;
+            pooledSamples += 1;
+        }
+
+        resamples += mean.size();
+        return mean.size();
+    }
+};
+
+// Benchmark noise: adds a gaussian sample of standard deviation sigma to the
+// fitness of every evaluated row of EVAL. The samples come from a stream
+// derived from the run seed, apart from the draws of the optimizer, and every
+// team member gets a stream of its own.
+template <typename EVAL>
+class NoisyEval
+{
+public:
+
+    static const uint64_t stream = 0x6E6F697365ULL;
+
+    EVAL eval;
+    Precision sigma;
+    uint64_t seed;
+    Random generator;
+
+public:
+
+    NoisyEval(EVAL eval,
+              Precision const sigma,
+              uint64_t const seed) :
+        eval(eval),
+        sigma(sigma),
+        seed(seed),
+        generator(Random::derive(seed, stream))
+    {
+
+    }
+};
+
+template <typename EVAL>
+NoisyEval<EVAL>
+noisy(EVAL eval, Precision const sigma, int const seed)
+{
+    return NoisyEval<EVAL>(eval, sigma, seed);
+}
+
+// Copy of team member k, a seed of 0 stays fresh for every member
+template <typename EVAL>
+void
+forkMember(NoisyEval<EVAL> & ne,
+           int const k)
+{
+    ne.generator.seed(Random::derive(ne.seed, NoisyEval<EVAL>::stream + k));
+}
+
+template <typename EVAL>
+void
+evaluate(NoisyEval<EVAL> & ne,
+         Particles & particles,
+         Refreshes & refresh,
+         Fitness & fitness,
+         Violations & violation)
+{
+    evaluate(ne.eval, particles, refresh, fitness, violation);
+
+    for (uint i=0;i!=refresh.size();++i)
+        if (refresh[i])
+            fitness[i] += ne.sigma * ne.generator.normalDouble();
+}
+
+template <typename EVAL>
+void
+evaluateNear(NoisyEval<EVAL> & ne,
+             Particles & particles,
+             Refreshes & refresh,
+             Fitness & fitness,
+             Violations & violation,
+             Particles const & reference)
+{
+    evaluateNear(ne.eval, particles, refresh, fitness, violation, reference);
+
+    for (uint i=0;i!=refresh.size();++i)
+        if (refresh[i])
+            fitness[i] += ne.sigma * ne.generator.normalDouble();
+}
+
+#endif // NOISE_HPP
@@ -0,0 +1,228 @@
+#ifndef NUMA_HPP
+#define NUMA_HPP
+
+#include <wup/wup.hpp>
+
+#include <atomic>
+#include <fstream>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace wup;
+using namespace std;
+
+// CPUs of each NUMA node, read from sysfs. The online nodes may have gaps in
+// their numbering and nodes without CPUs (memory only) are left out, so
+// nodeIds holds the sysfs number of every node kept. Machines without this
+// information are reported as a single node with all hardware threads.
+class NumaTopology
+{
+public:
+
+    vector<int> nodeIds;
+    vector<vector<int>> nodeCpus;
+
+public:
+
+    NumaTopology()
+    {
+        for (int node : parseCpuList(readLine("/sys/devices/system/node/online")))
+        {
+            vector<int> cpus = parseCpuList(readLine(cat("/sys/devices/system/node/node", node, "/cpulist")));
+
+            if (cpus.empty())
+                continue;
+
+            nodeIds.push_back(node);
+            nodeCpus.push_back(cpus);
+        }
+
+        if (nodeCpus.empty())
+        {
+            nodeIds.assign(1, 0);
+            nodeCpus.resize(1);
+            for (uint i=0;i!=std::thread::hardware_concurrency();++i)
+                nodeCpus[0].push_back(i);
+        }
+    }
+
+    int
+    numNodes() const
+    {
+        return nodeCpus.size();
+    }
+
+    int
+    numCpus() const
+    {
+        int total = 0;
+        for (auto & cpus : nodeCpus)
+            total += cpus.size();
+        return total;
+    }
+
+    // Spreads workers across the nodes, so a partial pool still uses the
+    // memory bandwidth of every node
+    void
+    placeWorker(int const worker,
+                int & node,
+                int & cpu) const
+    {
+        node = worker % numNodes();
+        auto & cpus = nodeCpus[node];
+        cpu = cpus.empty() ? -1 : cpus[(worker / numNodes()) % cpus.size()];
+    }
+
+    // First line of a sysfs file, empty when it can not be read
+    static std::string
+    readLine(std::string const & filename)
+    {
+        std::ifstream in(filename);
+        std::string line;
+        std::getline(in, line);
+        return line;
+    }
+
+    // Lists like "0-3,8,10-11", used by sysfs for CPUs and nodes
+    static vector<int>
+    parseCpuList(std::string const & line)
+    {
+        vector<int> cpus;
+        std::stringstream ss(line);
+        std::string range;
+
+        while (std::getline(ss, range, ','))
+        {
+            if (range.empty())
+                continue;
+
+            const size_t dash = range.find('-');
+            const int first = atoi(range.substr(0, dash).c_str());
+            const int last = dash == std::string::npos ? first : atoi(range.substr(dash+1).c_str());
+
+            for (int c=first;c<=last;++c)
+                cpus.push_back(c);
+        }
+
+        return cpus;
+    }
+};
+
+// Worker pool that pins each thread to a core and runs jobs inside the pinned
+// thread. Everything a job allocates and initializes, like the Population
+// buffers of a CDEEPSO built in the job, is first touched by that thread and
+// therefore placed on its local node.
+class NumaPool
+{
+public:
+
+    class NodeStats
+    {
+    public:
+        std::atomic<long> jobs;
+        std::atomic<long> evals;
+        std::atomic<long> busyMicros;
+        int workers;
+
+        NodeStats() : jobs(0), evals(0), busyMicros(0), workers(0) { }
+    };
+
+    NumaTopology topology;
+    int threads;
+    vector<std::unique_ptr<NodeStats>> stats;
+
+public:
+
+    NumaPool(int const threads) :
+        threads(threads <= 0 ? topology.numCpus() : threads)
+    {
+        for (int n=0;n!=topology.numNodes();++n)
+            stats.push_back(std::unique_ptr<NodeStats>(new NodeStats()));
+
+        for (int w=0;w!=this->threads;++w)
+        {
+            int node, cpu;
+            topology.placeWorker(w, node, cpu);
+            stats[node]->workers += 1;
+        }
+    }
+
+    // Runs job(tid, jid) for every jid in [0, jobs). The job returns the
+    // number of fitness evaluations it spent, used for the throughput report.
+    template <typename JOB>
+    void
+    run(int const jobs, JOB job)
+    {
+        std::atomic<int> next(0);
+        vector<std::thread> workers;
+
+        for (int w=0;w!=threads;++w)
+        {
+            int node, cpu;
+            topology.placeWorker(w, node, cpu);
+
+            workers.push_back(std::thread([&, w, node, cpu]() {
+                pin(cpu);
+                NodeStats & s = *stats[node];
+
+                for (int jid=next++;jid<jobs;jid=next++)
+                {
+                    auto start = std::chrono::steady_clock::now();
+                    const long evals = job(w, jid);
+                    auto end = std::chrono::steady_clock::now();
+
+                    s.jobs += 1;
+                    s.evals += evals;
+                    s.busyMicros += std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+                }
+            }));
+        }
+
+        for (auto & t : workers)
+            t.join();
+    }
+
+    static void
+    pin(int const cpu)
+    {
+#ifdef __linux__
+        if (cpu < 0)
+            return;
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+            print(RED, "Could not pin thread to cpu", cpu, NORMAL);
+#else
+        UNUSED(cpu);
+#endif
+    }
+
+    void
+    display(long double const totalMillis)
+    {
+        print(YELLOW, "\n--- CDEEPSO++ NUMA Nodes ---\n", WHITE);
+
+        for (int n=0;n!=topology.numNodes();++n)
+        {
+            NodeStats & s = *stats[n];
+
+            if (s.workers == 0)
+                continue;
+
+            print("Node", topology.nodeIds[n], ":", s.workers, "workers,", s.jobs.load(), "runs,",
+                  s.evals.load() / totalMillis, "fitEvals/ms,",
+                  s.busyMicros.load() / 1000.0 / s.workers / totalMillis * 100.0, "% busy");
+        }
+
+        printn(NORMAL);
+    }
+};
+
+#endif // NUMA_HPP
@@ -6,6 +6,44 @@
 namespace ops
 {
 
+// Feasibility rules: a feasible particle beats an infeasible one, two feasible
+// particles are compared by fitness and two infeasible ones by violation.
+// Without constraints every violation is zero and this is fitA < fitB.
+inline bool
+isBetter(Precision const fitA,
+         Precision const violA,
+         Precision const fitB,
+         Precision const violB)
+{
+    if (violA == violB)
+        return fitA < fitB;
+
+    return violA < violB;
+}
+
+inline int
+indexOfBest(Fitness const & fitness,
+            Violations const & violation)
+{
+    int best = 0;
+    for (uint i=1;i!=fitness.size();++i)
+        if (isBetter(fitness[i], violation[i], fitness[best], violation[best]))
+            best = i;
+    return best;
+}
+
+inline int
+indexOfWorst(Fitness const & fitness,
+             Violations const & violation)
+{
+    int worst = 0;
+    for (uint i=1;i!=fitness.size();++i)
+        if (isBetter(fitness[worst], violation[worst], fitness[i], violation[i]))
+            worst = i;
+    return worst;
+}
+
+// Initializes the rows from first on, the earlier ones are kept
 inline void
 initPopulation(Population & current,
                Random & generator,
@@ -13,12 +51,13 @@ initPopulation(Population & current,
                vector<double> const & xMax,
                vector<double> const & vMin,
                vector<double> const & vMax,
-               Precision const maxVelocity)
+               Precision const maxVelocity,
+               uint const first=0)
 {
-    for (uint i=0;i!=current.size();++i)
+    for (uint i=first;i<current.size();++i)
         current.weights[i].init(generator, maxVelocity);
 
-    for (uint i=0;i!=current.size();++i)
+    for (uint i=first;i<current.size();++i)
     {
         for (uint j=0;j!=current.dims();++j)
         {
@@ -31,22 +70,27 @@ initPopulation(Population & current,
 inline void
 initBests(Population & current,
           Fitness & fitness,
+          Violations & violation,
           Population & myBest,
           Fitness & myBestFitness,
+          Violations & myBestViolation,
           vector<Precision> & gBest,
-          Precision & gBestFit)
+          Precision & gBestFit,
+          Precision & gBestViolation)
 {
     myBest.cloneFrom(current);
     myBestFitness = fitness;
-    const int srcId = arr::indexOfMin(fitness);
+    myBestViolation = violation;
+    const int srcId = indexOfBest(fitness, violation);
     current.particles.exportRow(srcId, gBest);
     gBestFit = fitness[srcId];
+    gBestViolation = violation[srcId];
 }
 
 inline void
 initLimits(int const dims,
-           int const minValue,
-           int const maxValue,
+           Precision const minValue,
+           Precision const maxValue,
            vector<double> & xMin,
            vector<double> & xMax,
            vector<double> & vMin,
@@ -61,6 +105,26 @@ initLimits(int const dims,
     }
 }
 
+inline void
+initLimits(CDEEPSOParams const & p,
+           vector<double> & xMin,
+           vector<double> & xMax,
+           vector<double> & vMin,
+           vector<double> & vMax)
+{
+    initLimits(p.dims, p.xMin, p.xMax, xMin, xMax, vMin, vMax);
+
+    if (p.dimMin.empty())
+        return;
+
+    for (int i=0;i!=p.dims;++i)
+    {
+        xMin[i] = p.dimMin[i];
+        xMax[i] = p.dimMax[i];
+        vMin[i] = xMin[i] - xMax[i];
+        vMax[i] = -vMin[i];
+    }
+}
 
 inline void
 computeNewWeights(const Population & src,
@@ -72,6 +136,51 @@ computeNewWeights(const Population & src,
         dst.weights[i].copyWithNoise(src.weights[i], mutationRate, maxVelocity);
 }
 
+inline void
+computeNewWeights(Population & dst,
+                  WeightHistory const & history,
+                  Random & generator,
+                  Precision const scale,
+                  Precision const maxVelocity)
+{
+    for (uint i=0;i!=dst.size();++i)
+        history.sample(dst.weights[i], generator, scale, maxVelocity);
+}
+
+// Velocity of one particle over the columns [first, last): inertia, memory
+// and, for each column with probability communicationProbability,
+// cooperation with the guide row scaled by noise, clamped to [vMin, vMax].
+// d may be vel. Every velocity update of the swarm goes through it.
+inline void
+newVelocityRow(Weight const & weight,
+               Precision const * const pos,
+               Precision const * const vel,
+               Precision const * const mbp,
+               Precision const * const guide,
+               Precision const noise,
+               Random & generator,
+               vector<double> const & vMin,
+               vector<double> const & vMax,
+               Precision const communicationProbability,
+               Precision * const d,
+               uint const first,
+               uint const last)
+{
+    for (uint k=first;k!=last;++k)
+    {
+        const double it = weight.pInertia * vel[k];
+        const double mt = weight.pMemory * (mbp[k] - pos[k]);
+
+        const Precision ct = generator.unfairCoin(communicationProbability)
+                ? weight.pCooperation * (guide[k] * noise - pos[k])
+                : 0.0;
+
+        const double tmp = it + mt + ct;
+
+        d[k] = tmp > vMax[k] ? vMax[k] : tmp < vMin[k] ? vMin[k] : tmp;
+    }
+}
+
 inline void
 computeNewVel(Population & pop,
               Random & generator,
@@ -84,33 +193,38 @@ computeNewVel(Population & pop,
     for (uint i=0;i!=pop.size();++i)
     {
         const Weight & weight = pop.weights[i];
-        const Precision * pos = & pop.particles(i,0);
-        const Precision * vel = & pop.velocity(i,0);
-        const Precision * mbp = & myBest.particles(i,0);
-
-        Precision * d = & pop.velocity(i,0);
         const Precision noise = 1.0 + weight.pPerturbation * generator.normalDouble();
 
-        for (uint k=0;k!=pop.dims();++k)
-        {
-            const double it = weight.pInertia * vel[k];
-            const double mt = weight.pMemory * (mbp[k] - pos[k]);
-
-            const Precision ct = generator.unfairCoin(communicationProbability)
-                    ? weight.pCooperation * (gBest[k] * noise - pos[k])
-                    : 0.0;
+        newVelocityRow(weight, &pop.particles(i,0), &pop.velocity(i,0), &myBest.particles(i,0), gBest.data(),
+                       noise, generator, vMin, vMax, communicationProbability, &pop.velocity(i,0), 0, pop.dims());
+    }
+}
 
-            const double tmp = it + mt + ct;
+// Same as computeNewVel, but each particle cooperates with its own guide row
+// instead of a single gBest
+inline void
+computeNewVel(Population & pop,
+              Random & generator,
+              Population const & myBest,
+              Particles const & guides,
+              vector<double> const & vMin,
+              vector<double> const & vMax,
+              Precision const communicationProbability)
+{
+    for (uint i=0;i!=pop.size();++i)
+    {
+        const Weight & weight = pop.weights[i];
+        const Precision noise = 1.0 + weight.pPerturbation * generator.normalDouble();
 
-            d[k] = tmp > vMax[k] ? vMax[k] : tmp < vMin[k] ? vMin[k] : tmp;
-        }
+        newVelocityRow(weight, &pop.particles(i,0), &pop.velocity(i,0), &myBest.particles(i,0), &guides(i,0),
+                       noise, generator, vMin, vMax, communicationProbability, &pop.velocity(i,0), 0, pop.dims());
     }
 }
 
 inline void
 computeNewPos(Population & pop)
 {
-    const Precision * const posEnd = pop.particles.end();
+    const Precision * const posEnd = pop.particles.begin() + pop.size() * pop.dims();
     const Precision * posPtr = pop.particles.begin();
     const Precision * velPtr = pop.velocity.begin();
     Precision * newPosPtr = pop.particles.begin();
@@ -125,50 +239,173 @@ computeNewPos(Population & pop)
     }
 }
 
-inline void
-enforceLimits(Population & pop,
-              vector<double> & xMin,
-              vector<double> & xMax,
-              vector<double> & vMin,
-              vector<double> & vMax)
+// Brings a row back into [xMin, xMax] and its velocity into [vMin, vMax],
+// then rounds the integer dimensions. par holds the position the particle
+// moved from, when null it is recovered as pos - vel.
+//
+// Each strategy is written as a branch free pass over the columns so the
+// compiler can vectorize it. REINIT draws random numbers only for the
+// violations. apply() works on a range of columns, so the fused kernels can
+// bound a row tile by tile while it is in cache.
+class RowLimits
 {
-    for (uint i=0;i!=pop.size();++i)
+public:
+
+    double const * const mn;
+    double const * const mx;
+    double const * const vmn;
+    double const * const vmx;
+    vector<int> const & intDims;
+    CDEEPSOParams::BoundStrategy const strategy;
+    Random & generator;
+
+public:
+
+    RowLimits(vector<double> const & xMin,
+              vector<double> const & xMax,
+              vector<double> const & vMin,
+              vector<double> const & vMax,
+              vector<int> const & intDims,
+              CDEEPSOParams::BoundStrategy const strategy,
+              Random & generator) :
+        mn(xMin.data()),
+        mx(xMax.data()),
+        vmn(vMin.data()),
+        vmx(vMax.data()),
+        intDims(intDims),
+        strategy(strategy),
+        generator(generator)
     {
-        for (uint j=0;j!=pop.dims();++j)
+
+    }
+
+    void
+    apply(Precision * const pos,
+          Precision * const vel,
+          Precision const * const par,
+          uint const first,
+          uint const last) const
+    {
+        switch (strategy)
         {
-            if (pop.particles(i,j) < xMin[j])
+        case CDEEPSOParams::BoundStrategy::REFLECT:
+            for (uint j=first;j!=last;++j)
             {
-                pop.particles(i,j) = xMin[j];
-                if (pop.velocity(i,j) < 0)
-                    pop.velocity(i,j) = -pop.velocity(i,j);
+                const Precision x = pos[j];
+                const Precision r = x < mn[j] ? 2 * mn[j] - x : x > mx[j] ? 2 * mx[j] - x : x;
+                pos[j] = r < mn[j] ? mn[j] : r > mx[j] ? mx[j] : r;
             }
+            break;
 
-            else if (pop.particles(i,j) > xMax[j])
+        case CDEEPSOParams::BoundStrategy::WRAP:
+            for (uint j=first;j!=last;++j)
             {
-                pop.particles(i,j) = xMax[j];
-                if (pop.velocity(i,j) > 0)
-                    pop.velocity(i,j) = -pop.velocity(i,j);
+                const Precision x = pos[j];
+                const Precision range = mx[j] - mn[j];
+                const Precision w = x < mn[j] ? x + range * std::ceil((mn[j] - x) / range)
+                                  : x > mx[j] ? x - range * std::ceil((x - mx[j]) / range)
+                                  : x;
+                pos[j] = w < mn[j] ? mn[j] : w > mx[j] ? mx[j] : w;
             }
+            break;
 
-            if (pop.velocity(i,j) < vMin[j])
-                pop.velocity(i,j) = vMin[j];
+        case CDEEPSOParams::BoundStrategy::REINIT:
+            for (uint j=first;j!=last;++j)
+                if (pos[j] < mn[j] || pos[j] > mx[j])
+                    pos[j] = mn[j] + (mx[j] - mn[j]) * generator.uniformDouble();
+            break;
 
-            else if (pop.velocity(i,j) > vMax[j])
-                pop.velocity(i,j) = vMax[j];
+        case CDEEPSOParams::BoundStrategy::MIDPOINT:
+            for (uint j=first;j!=last;++j)
+            {
+                const Precision x = pos[j];
+                const Precision from = par ? par[j] : x - vel[j];
+                const Precision m = x < mn[j] ? (mn[j] + from) * 0.5 : x > mx[j] ? (mx[j] + from) * 0.5 : x;
+                pos[j] = m < mn[j] ? mn[j] : m > mx[j] ? mx[j] : m;
+            }
+            break;
+
+        case CDEEPSOParams::BoundStrategy::CLAMP:
+        default:
+            for (uint j=first;j!=last;++j)
+            {
+                const Precision x = pos[j];
+                const Precision v = vel[j];
+                const bool below = x < mn[j];
+                const bool above = x > mx[j];
+
+                pos[j] = below ? mn[j] : above ? mx[j] : x;
+                vel[j] = (below && v < 0) || (above && v > 0) ? -v : v;
+            }
+            break;
+        }
+
+        for (uint j=first;j!=last;++j)
+        {
+            const Precision v = vel[j];
+            vel[j] = v < vmn[j] ? vmn[j] : v > vmx[j] ? vmx[j] : v;
         }
     }
+
+    void
+    round(Precision * const pos) const
+    {
+        for (uint k=0;k!=intDims.size();++k)
+        {
+            const int j = intDims[k];
+            const Precision x = std::round(pos[j]);
+            pos[j] = x < mn[j] ? std::ceil(mn[j]) : x > mx[j] ? std::floor(mx[j]) : x;
+        }
+    }
+
+    void
+    operator()(Precision * const pos,
+               Precision * const vel,
+               Precision const * const par,
+               uint const dims) const
+    {
+        apply(pos, vel, par, 0, dims);
+        round(pos);
+    }
+};
+
+// Applies RowLimits to every row, parent holds the positions the particles
+// moved from
+inline void
+enforceLimits(Population & pop,
+              Population const * const parent,
+              vector<double> const & xMin,
+              vector<double> const & xMax,
+              vector<double> const & vMin,
+              vector<double> const & vMax,
+              vector<int> const & intDims,
+              CDEEPSOParams::BoundStrategy const strategy,
+              Random & generator)
+{
+    const RowLimits limits(xMin, xMax, vMin, vMax, intDims, strategy, generator);
+
+    for (uint i=0;i!=pop.size();++i)
+        limits(& pop.particles(i,0), & pop.velocity(i,0), parent ? & parent->particles(i,0) : nullptr, pop.dims());
 }
 
+// Weights of src that won are recorded in history, when given
 inline void
 mergePopulations(Population const & src,
                  Population & dst,
                  Fitness & srcFitness,
-                 Fitness & dstFitness)
+                 Violations & srcViolation,
+                 Fitness & dstFitness,
+                 Violations & dstViolation,
+                 WeightHistory * const history=nullptr,
+                 Precision const maxVelocity=1.0)
 {
     for (uint i=0;i!=src.size();++i)
     {
-        if (srcFitness[i] < dstFitness[i])
+        if (isBetter(srcFitness[i], srcViolation[i], dstFitness[i], dstViolation[i]))
         {
+            if (history)
+                history->record(src.weights[i], dstFitness[i] - srcFitness[i], maxVelocity);
+
             dst.particles.importRow(src.particles, i, i);
             dst.velocity.importRow(src.velocity, i, i);
             dst.weights[i] = src.weights[i];
@@ -180,87 +417,109 @@ mergePopulations(Population const & src,
 inline void
 updateGBest(Population const & pop,
             Fitness const & popFitness,
+            Violations const & popViolation,
             Population & memGBest,
             Fitness & memGBestFitness,
+            Violations & memGBestViolation,
             int & memGBestIndex,
             vector<Precision> & gBest,
-            Precision & gBestFit)
+            Precision & gBestFit,
+            Precision & gBestViolation)
 {
-    const int srcId = arr::indexOfMin(popFitness);
+    const int srcId = indexOfBest(popFitness, popViolation);
 
-    if (popFitness[srcId] < gBestFit)
+    if (isBetter(popFitness[srcId], popViolation[srcId], gBestFit, gBestViolation))
     {
         pop.particles.exportRow(srcId, gBest);
         gBestFit = popFitness[srcId];
+        gBestViolation = popViolation[srcId];
 
         const int dstId = memGBestIndex == int(memGBest.size())
-                ? arr::indexOfMax(memGBestFitness)
+                ? indexOfWorst(memGBestFitness, memGBestViolation)
                 : memGBestIndex++;
 
         memGBest.particles.importRow(pop.particles, srcId, dstId);
         memGBest.velocity.importRow(pop.velocity, srcId, dstId);
         memGBest.weights[dstId] = pop.weights[srcId];
         memGBestFitness[dstId] = popFitness[srcId];
+        memGBestViolation[dstId] = popViolation[srcId];
     }
 }
 
-inline void
+// Returns the number of particles that improved their best
+inline int
 updateMyBestPos(Population const & pop,
                 Fitness const & popFitness,
+                Violations const & popViolation,
                 Population & myBest,
-                Fitness & myBestFitness)
+                Fitness & myBestFitness,
+                Violations & myBestViolation)
 {
+    int improved = 0;
+
     for (uint i=0;i!=pop.size();++i)
     {
-        if (popFitness[i] < myBestFitness[i])
+        if (isBetter(popFitness[i], popViolation[i], myBestFitness[i], myBestViolation[i]))
         {
+            ++improved;
             myBest.particles.importRow(pop.particles, i, i);
             myBest.velocity.importRow(pop.velocity, i, i);
             myBest.weights[i] = pop.weights[i];
             myBestFitness[i] = popFitness[i];
+            myBestViolation[i] = popViolation[i];
         }
     }
+
+    return improved;
 }
 
 inline void
 updateCandidates(int const k,
                  Population const & pop,
                  Fitness const & popFitness,
+                 Violations const & popViolation,
                  Fitness & memGBestFitness,
+                 Violations & memGBestViolation,
                  vector<int> & candidates,
                  int const memGBestIndex,
                  CDEEPSOParams::MemStrategy const memStrategy)
 {
     const double particleFit = popFitness[k];
+    const double particleViol = popViolation[k];
     candidates.clear();
 
     if (memStrategy & CDEEPSOParams::MemStrategy::MEM)
         for (int i=0;i!=memGBestIndex;++i)
-            if (memGBestFitness[i] < particleFit)
+            if (isBetter(memGBestFitness[i], memGBestViolation[i], particleFit, particleViol))
                 candidates.push_back(-i);
 
     if (memStrategy & CDEEPSOParams::MemStrategy::POS)
         for (uint i=0;i!=pop.size();++i)
-            if (popFitness[i] < particleFit)
+            if (isBetter(popFitness[i], popViolation[i], particleFit, particleViol))
                 candidates.push_back(i+1);
 }
 
+// With limits, each new row is bounded while it is still in cache and the
+// rows that are not refreshed are not copied, the merge never takes them
 inline void
 heuristicRand(Population const & src,
               Fitness const & srcFitness,
+              Violations const & srcViolation,
               Population & dst,
               Population & myBest,
               Population & memGBest,
               Fitness & memGBestFitness,
+              Violations & memGBestViolation,
               int const memGBestIndex,
               CDEEPSOParams::MemStrategy const memStrategy,
               vector<int> & candidates,
               vector<bool> & dstRefresh,
-              Random & generator)
+              Random & generator,
+              RowLimits const * const limits=nullptr)
 {
     for (uint i=0;i!=src.size();++i)
     {
-        updateCandidates(i, src, srcFitness, memGBestFitness, candidates, memGBestIndex, memStrategy);
+        updateCandidates(i, src, srcFitness, srcViolation, memGBestFitness, memGBestViolation, candidates, memGBestIndex, memStrategy);
 
         if (candidates.size() >= 3)
         {
@@ -292,8 +551,11 @@ heuristicRand(Population const & src,
             for (uint j=0;j!=src.dims();++j)
                 if (generator.unfairCoin(w.dThreshold) || j == tmpIndexD)
                     d[j] = mbp[j];
+
+            if (limits)
+                (*limits)(d, & dst.velocity(i,0), & src.particles(i,0), src.dims());
         }
-        else
+        else if (!limits)
         {
             dst.particles.importRow(src.particles, i, i);
             dst.velocity.importRow(src.velocity, i, i);
@@ -305,19 +567,22 @@ heuristicRand(Population const & src,
 void
 heuristicBest(const Population & src,
               Fitness const & srcFitness,
+              Violations const & srcViolation,
               Population & dst,
               vector<Precision> & gBest,
               Population & memGBest,
               Fitness & memGBestFitness,
+              Violations & memGBestViolation,
               int const memGBestIndex,
               CDEEPSOParams::MemStrategy const memStrategy,
               vector<int> & candidates,
               vector<bool> & dstRefresh,
-              Random & generator)
+              Random & generator,
+              RowLimits const * const limits=nullptr)
 {
     for (uint i=0;i!=src.size();++i)
     {
-        updateCandidates(i, src, srcFitness, memGBestFitness, candidates, memGBestIndex, memStrategy);
+        updateCandidates(i, src, srcFitness, srcViolation, memGBestFitness, memGBestViolation, candidates, memGBestIndex, memStrategy);
 
         if (candidates.size() >= 2)
         {
@@ -344,8 +609,11 @@ heuristicBest(const Population & src,
             for (uint j=0;j!=src.dims();++j)
                 if (generator.unfairCoin(w.dThreshold) || j == tmpIndexD)
                     d[j] = gBest[j];
+
+            if (limits)
+                (*limits)(d, & dst.velocity(i,0), & src.particles(i,0), src.dims());
         }
-        else
+        else if (!limits)
         {
             dst.particles.importRow(src.particles, i, i);
             dst.velocity.importRow(src.velocity, i, i);
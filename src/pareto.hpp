@@ -0,0 +1,315 @@
+#ifndef PARETO_HPP
+#define PARETO_HPP
+
+#include "population.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+typedef Bundle<Precision> ObjectiveVectors;
+
+// Bounded archive of non-dominated solutions, all objectives minimized.
+//
+// With two objectives the archive is kept sorted by the first objective, which
+// makes the second one strictly decreasing. An insertion then finds the
+// dominance relations with a binary search and the points it dominates are a
+// contiguous range, so it costs O(log n) comparisons plus one block move. With
+// more objectives the insertion falls back to a linear scan.
+//
+// The archive may grow past its capacity during a generation, truncate() then
+// removes the most crowded points in a single O(n log n) pass.
+class ParetoArchive
+{
+public:
+
+    int dims;
+    int numObjs;
+    int capacity;
+
+    vector<Precision> positions;
+    vector<Precision> objectives;
+    vector<Weight> weights;
+    vector<Precision> crowding;
+
+public:
+
+    ParetoArchive(int const dims,
+                  int const numObjs,
+                  int const capacity) :
+        dims(dims),
+        numObjs(numObjs),
+        capacity(capacity)
+    {
+
+    }
+
+    int
+    size() const
+    {
+        return weights.size();
+    }
+
+    Precision const *
+    position(int const i) const
+    {
+        return &positions[i * dims];
+    }
+
+    Precision const *
+    objective(int const i) const
+    {
+        return &objectives[i * numObjs];
+    }
+
+    static bool
+    dominates(Precision const * const a,
+              Precision const * const b,
+              int const numObjs)
+    {
+        bool strictly = false;
+
+        for (int k=0;k!=numObjs;++k)
+        {
+            if (a[k] > b[k])
+                return false;
+            if (a[k] < b[k])
+                strictly = true;
+        }
+
+        return strictly;
+    }
+
+    static bool
+    weaklyDominates(Precision const * const a,
+                    Precision const * const b,
+                    int const numObjs)
+    {
+        for (int k=0;k!=numObjs;++k)
+            if (a[k] > b[k])
+                return false;
+        return true;
+    }
+
+    // Returns true when the point entered the archive
+    bool
+    insert(Precision const * const x,
+           Precision const * const f,
+           Weight const & w)
+    {
+        return numObjs == 2 ? insertSorted(x, f, w) : insertLinear(x, f, w);
+    }
+
+    bool
+    insertSorted(Precision const * const x,
+                 Precision const * const f,
+                 Weight const & w)
+    {
+        int lo = 0;
+        int hi = size();
+
+        while (lo < hi)
+        {
+            const int mid = (lo + hi) / 2;
+            if (objective(mid)[0] < f[0]) lo = mid + 1;
+            else hi = mid;
+        }
+
+        if (lo > 0 && objective(lo-1)[1] <= f[1])
+            return false;
+
+        if (lo < size() && objective(lo)[0] == f[0] && objective(lo)[1] <= f[1])
+            return false;
+
+        int last = lo;
+        while (last < size() && objective(last)[1] >= f[1])
+            ++last;
+
+        replaceRange(lo, last, x, f, w);
+        return true;
+    }
+
+    bool
+    insertLinear(Precision const * const x,
+                 Precision const * const f,
+                 Weight const & w)
+    {
+        int kept = 0;
+
+        for (int i=0;i!=size();++i)
+        {
+            if (weaklyDominates(objective(i), f, numObjs))
+                return false;
+
+            if (!dominates(f, objective(i), numObjs))
+                moveEntry(i, kept++);
+        }
+
+        resize(kept);
+        replaceRange(kept, kept, x, f, w);
+        return true;
+    }
+
+    // Keeps the capacity least crowded points, preserving their order
+    void
+    truncate()
+    {
+        computeCrowding();
+
+        if (size() <= capacity)
+            return;
+
+        vector<int> order(size());
+        std::iota(order.begin(), order.end(), 0);
+        std::nth_element(order.begin(), order.begin() + capacity, order.end(),
+                         [&](int a, int b) { return crowding[a] > crowding[b]; });
+
+        vector<bool> keep(size(), false);
+        for (int i=0;i!=capacity;++i)
+            keep[order[i]] = true;
+
+        int kept = 0;
+        for (int i=0;i!=size();++i)
+            if (keep[i])
+                moveEntry(i, kept++);
+
+        resize(kept);
+        computeCrowding();
+    }
+
+    void
+    computeCrowding()
+    {
+        const int n = size();
+        crowding.assign(n, 0.0);
+
+        if (n <= 2)
+        {
+            std::fill(crowding.begin(), crowding.end(), std::numeric_limits<Precision>::infinity());
+            return;
+        }
+
+        vector<int> order(n);
+
+        for (int k=0;k!=numObjs;++k)
+        {
+            std::iota(order.begin(), order.end(), 0);
+
+            if (!(numObjs == 2 && k == 0))
+                std::sort(order.begin(), order.end(),
+                          [&](int a, int b) { return objective(a)[k] < objective(b)[k]; });
+
+            const Precision fMin = objective(order[0])[k];
+            const Precision fMax = objective(order[n-1])[k];
+            const Precision range = fMax - fMin > 0.0 ? fMax - fMin : 1.0;
+
+            crowding[order[0]] = std::numeric_limits<Precision>::infinity();
+            crowding[order[n-1]] = std::numeric_limits<Precision>::infinity();
+
+            for (int i=1;i!=n-1;++i)
+                crowding[order[i]] += (objective(order[i+1])[k] - objective(order[i-1])[k]) / range;
+        }
+    }
+
+    // Binary tournament that prefers the less crowded of two random points
+    int
+    sample(Random & generator) const
+    {
+        const int a = generator.uniformInt(size());
+        const int b = generator.uniformInt(size());
+
+        if (crowding.size() != weights.size())
+            return a;
+
+        return crowding[a] >= crowding[b] ? a : b;
+    }
+
+    // Area dominated by the archive up to ref, two objectives only
+    Precision
+    hypervolume(Precision const ref0,
+                Precision const ref1) const
+    {
+        if (numObjs != 2)
+            error("Hypervolume is only available for two objectives");
+
+        Precision hv = 0.0;
+        Precision prevF1 = ref1;
+
+        for (int i=0;i!=size();++i)
+        {
+            Precision const * const f = objective(i);
+
+            if (f[0] < ref0 && f[1] < prevF1)
+            {
+                hv += (ref0 - f[0]) * (prevF1 - f[1]);
+                prevF1 = f[1];
+            }
+        }
+
+        return hv;
+    }
+
+private:
+
+    void
+    moveEntry(int const src,
+              int const dst)
+    {
+        if (src == dst)
+            return;
+
+        std::copy(position(src), position(src) + dims, &positions[dst * dims]);
+        std::copy(objective(src), objective(src) + numObjs, &objectives[dst * numObjs]);
+        weights[dst] = weights[src];
+    }
+
+    void
+    resize(int const n)
+    {
+        positions.resize(n * dims);
+        objectives.resize(n * numObjs);
+        weights.resize(n);
+    }
+
+    // Replaces the entries in [first, last) by a single new entry
+    void
+    replaceRange(int const first,
+                 int const last,
+                 Precision const * const x,
+                 Precision const * const f,
+                 Weight const & w)
+    {
+        replaceRows(positions, dims, first, last, x);
+        replaceRows(objectives, numObjs, first, last, f);
+        replaceRows(weights, 1, first, last, &w);
+    }
+
+private:
+
+    // Rows of width values: the tail after last moves once, right behind
+    // the new row written at first
+    template <typename T>
+    static void
+    replaceRows(vector<T> & rows,
+                int const width,
+                int const first,
+                int const last,
+                T const * const row)
+    {
+        const size_t n = rows.size();
+
+        if (first == last)
+        {
+            rows.resize(n + width);
+            std::move_backward(rows.begin() + first * width, rows.begin() + n, rows.end());
+        }
+        else
+        {
+            std::move(rows.begin() + last * width, rows.end(), rows.begin() + (first + 1) * width);
+            rows.resize(n - (last - first - 1) * width);
+        }
+
+        std::copy(row, row + width, rows.begin() + first * width);
+    }
+};
+
+#endif // PARETO_HPP
@@ -0,0 +1,564 @@
+#ifndef PLANNER_HPP
+#define PLANNER_HPP
+
+#include "cdeepso.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// Threads of a planned execution that are not driving a run. Runs borrow
+// helpers from it and give them back when they end. Once no run is waiting
+// to start, the idle threads are shared among the running runs.
+class ThreadBudget
+{
+public:
+
+    std::atomic<int> idle;
+    std::atomic<int> waiting;
+    std::atomic<int> running;
+
+public:
+
+    ThreadBudget(int const idle,
+                 int const runs) :
+        idle(idle),
+        waiting(runs),
+        running(0)
+    {
+
+    }
+
+    // Takes up to n threads, returns how many were taken
+    int
+    acquire(int const n)
+    {
+        int current = idle.load();
+        int taken;
+
+        do
+        {
+            taken = std::min(current, n);
+            if (taken <= 0)
+                return 0;
+        }
+        while (!idle.compare_exchange_weak(current, current - taken));
+
+        return taken;
+    }
+
+    void
+    release(int const n)
+    {
+        idle += n;
+    }
+
+    // Threads a running run may add now
+    int
+    share() const
+    {
+        if (waiting.load() > 0)
+            return 0;
+
+        const int runs = std::max(1, running.load());
+        return (idle.load() + runs - 1) / runs;
+    }
+};
+
+// Helper threads that evaluate a batch together with the thread of the run,
+// which is member 0. Rounds are handed over with a mutex and two condition
+// variables, the helpers sleep between batches.
+class EvalTeam
+{
+public:
+
+    ThreadBudget * budget;
+    int maxSize;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::function<void(int)> job;
+    long round;
+    int pending;
+    bool stop;
+
+    vector<std::thread> helpers;
+
+public:
+
+    // Without a budget the team simply has width members
+    EvalTeam(ThreadBudget * budget,
+             int const width,
+             int const maxSize) :
+        budget(budget),
+        maxSize(std::max(1, maxSize)),
+        round(0),
+        pending(0),
+        stop(false)
+    {
+        const int wanted = std::min(width, this->maxSize) - 1;
+
+        if (budget)
+        {
+            budget->running += 1;
+            grow(budget->acquire(wanted));
+        }
+        else
+        {
+            grow(wanted);
+        }
+    }
+
+    ~EvalTeam()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+
+        wake.notify_all();
+
+        for (auto & t : helpers)
+            t.join();
+
+        if (budget)
+        {
+            budget->release(helpers.size());
+            budget->running -= 1;
+        }
+    }
+
+    int
+    size() const
+    {
+        return helpers.size() + 1;
+    }
+
+    // Called between batches, adds the run's share of the idle threads
+    void
+    adjust()
+    {
+        if (!budget || size() >= maxSize)
+            return;
+
+        const int extra = std::min(budget->share(), maxSize - size());
+
+        if (extra > 0)
+            grow(budget->acquire(extra));
+    }
+
+    // Calls job(member) for every member and returns when all are done
+    template <typename JOB>
+    void
+    run(JOB job)
+    {
+        if (helpers.empty())
+        {
+            job(0);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            this->job = job;
+            pending = helpers.size();
+            ++round;
+        }
+
+        wake.notify_all();
+        job(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&]() { return pending == 0; });
+    }
+
+private:
+
+    void
+    grow(int const n)
+    {
+        for (int k=0;k!=n;++k)
+        {
+            const int member = helpers.size() + 1;
+            const long seen = round;
+
+            helpers.push_back(std::thread([this, member, seen]() {
+                serve(member, seen);
+            }));
+        }
+    }
+
+    void
+    serve(int const member,
+          long seen)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        for (;;)
+        {
+            wake.wait(lock, [&]() { return stop || round != seen; });
+
+            if (stop)
+                return;
+
+            seen = round;
+            lock.unlock();
+            job(member);
+            lock.lock();
+
+            if (--pending == 0)
+                done.notify_one();
+        }
+    }
+};
+
+// Called on the copy of the evaluator made for team member k. Evaluators with
+// state that must differ between the members, e.g. a generator, overload it.
+template <typename EVAL>
+void
+forkMember(EVAL &,
+           int const)
+{
+
+}
+
+// Evaluator that splits the refreshed rows of a batch into contiguous slices,
+// one per team member. Every member has its own copy of EVAL and its own
+// refresh flags, so stateful evaluators are never shared between threads.
+// Small batches, like the ones of the local search, are evaluated inline.
+template <typename EVAL>
+class TeamEval
+{
+public:
+
+    vector<EVAL> evals;
+    EvalTeam * team;
+    vector<Refreshes> slices;
+    vector<int> owner;
+
+public:
+
+    TeamEval(EVAL eval,
+             EvalTeam & team) :
+        evals(1, eval),
+        team(&team)
+    {
+
+    }
+
+    // Returns false when the batch should be evaluated inline
+    bool
+    split(Refreshes const & refresh)
+    {
+        team->adjust();
+
+        const int members = team->size();
+        int n = 0;
+
+        for (uint i=0;i!=refresh.size();++i)
+            n += refresh[i];
+
+        if (members == 1 || n < 2 * members)
+            return false;
+
+        while (int(evals.size()) < members)
+        {
+            evals.push_back(evals[0]);
+            forkMember(evals.back(), evals.size() - 1);
+        }
+
+        slices.resize(members);
+        for (auto & s : slices)
+            s.assign(refresh.size(), false);
+
+        owner.assign(refresh.size(), -1);
+
+        for (uint i=0,k=0;i!=refresh.size();++i)
+        {
+            if (refresh[i])
+            {
+                owner[i] = k++ * members / n;
+                slices[owner[i]][i] = true;
+            }
+        }
+
+        return true;
+    }
+
+    // Flags cleared by a member, e.g. skipped infeasible particles, are
+    // cleared in the batch too
+    void
+    merge(Refreshes & refresh)
+    {
+        for (uint i=0;i!=refresh.size();++i)
+            if (refresh[i])
+                refresh[i] = slices[owner[i]][i];
+    }
+};
+
+template <typename EVAL>
+TeamEval<EVAL>
+inTeam(EVAL eval, EvalTeam & team)
+{
+    return TeamEval<EVAL>(eval, team);
+}
+
+template <typename EVAL>
+void
+evaluate(TeamEval<EVAL> & te,
+         Particles & particles,
+         Refreshes & refresh,
+         Fitness & fitness,
+         Violations & violation)
+{
+    if (!te.split(refresh))
+    {
+        evaluate(te.evals[0], particles, refresh, fitness, violation);
+        return;
+    }
+
+    te.team->run([&](int const t) {
+        evaluate(te.evals[t], particles, te.slices[t], fitness, violation);
+    });
+
+    te.merge(refresh);
+}
+
+template <typename EVAL>
+void
+evaluateNear(TeamEval<EVAL> & te,
+             Particles & particles,
+             Refreshes & refresh,
+             Fitness & fitness,
+             Violations & violation,
+             Particles const & reference)
+{
+    if (!te.split(refresh))
+    {
+        evaluateNear(te.evals[0], particles, refresh, fitness, violation, reference);
+        return;
+    }
+
+    te.team->run([&](int const t) {
+        evaluateNear(te.evals[t], particles, te.slices[t], fitness, violation, reference);
+    });
+
+    te.merge(refresh);
+}
+
+// Evaluator that measures the time spent inside EVAL and counts the rows it
+// was given, used by the calibration. Rows skipped by constrained evaluators
+// do not count as fitEvals, so the rows are counted here.
+template <typename EVAL>
+class TimedEval
+{
+public:
+
+    EVAL eval;
+    double * micros;
+    long * rows;
+
+public:
+
+    TimedEval(EVAL eval,
+              double * micros,
+              long * rows) :
+        eval(eval),
+        micros(micros),
+        rows(rows)
+    {
+
+    }
+
+    template <typename CALL>
+    void
+    time(Refreshes const & refresh,
+         CALL call)
+    {
+        for (uint i=0;i!=refresh.size();++i)
+            *rows += refresh[i];
+
+        auto start = std::chrono::steady_clock::now();
+        call();
+        *micros += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+template <typename EVAL>
+void
+evaluate(TimedEval<EVAL> & te,
+         Particles & particles,
+         Refreshes & refresh,
+         Fitness & fitness,
+         Violations & violation)
+{
+    te.time(refresh, [&]() { evaluate(te.eval, particles, refresh, fitness, violation); });
+}
+
+template <typename EVAL>
+void
+evaluateNear(TimedEval<EVAL> & te,
+             Particles & particles,
+             Refreshes & refresh,
+             Fitness & fitness,
+             Violations & violation,
+             Particles const & reference)
+{
+    te.time(refresh, [&]() { evaluateNear(te.eval, particles, refresh, fitness, violation, reference); });
+}
+
+// Split of the threads between concurrent runs (runners) and the evaluation
+// inside each run (width). A run costs, per fitness evaluation, the serial
+// work of the optimizer plus the evaluation divided among the width members,
+// and every batch of a team pays the dispatch latency. Runs execute in waves
+// of runners, the last partial wave gets the threads of the finished ones.
+class ParallelPlan
+{
+public:
+
+    int threads;
+    int runs;
+    int popSize;
+    int maxFitEval;
+
+    double evalMicros;
+    double serialMicros;
+    double dispatchMicros;
+
+    int runners;
+    int width;
+
+public:
+
+    ParallelPlan(CDEEPSOParams const & p) :
+        threads(p.threads > 0 ? p.threads : std::max(1u, std::thread::hardware_concurrency())),
+        runs(p.maxRun),
+        popSize(p.popSize),
+        maxFitEval(p.maxFitEval),
+        evalMicros(0.0),
+        serialMicros(0.0),
+        dispatchMicros(0.0),
+        runners(std::min(threads, runs)),
+        width(1)
+    {
+
+    }
+
+    double
+    runMillis(int const width) const
+    {
+        const int w = std::max(1, std::min(width, popSize));
+        const double batches = double(maxFitEval) / popSize;
+
+        return (maxFitEval * (serialMicros + evalMicros / w) + (w > 1 ? batches * dispatchMicros : 0.0)) / 1000.0;
+    }
+
+    double
+    estimateMillis(int const runners) const
+    {
+        const int waves = runs / runners;
+        const int last = runs % runners;
+
+        return waves * runMillis(threads / runners) + (last ? runMillis(threads / last) : 0.0);
+    }
+
+    // Picks the fastest split, more runners on ties
+    void
+    choose()
+    {
+        runners = std::min(threads, runs);
+        double best = estimateMillis(runners);
+
+        for (int r=runners-1;r>=1;--r)
+        {
+            const double t = estimateMillis(r);
+
+            if (t < best * 0.99)
+            {
+                best = t;
+                runners = r;
+            }
+        }
+
+        width = std::max(1, threads / runners);
+    }
+
+    // Times a short run of the real evaluator and the round trip of a team
+    template <typename EVAL>
+    void
+    calibrate(CDEEPSOParams const & p,
+              EVAL eval)
+    {
+        CDEEPSOParams cp = p;
+        cp.printConvergenceResults = 0;
+        cp.localSearch = CDEEPSOParams::LocalSearch::NONE;
+
+        double inEval = 0.0;
+        long rows = 0;
+        TimedEval<EVAL> timed(eval, &inEval, &rows);
+        CDEEPSO m(cp);
+
+        auto start = std::chrono::steady_clock::now();
+        auto elapsed = [&]() { return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count(); };
+
+        m.start(timed);
+        for (int g=0;g!=50 && elapsed() < 20000.0;++g)
+            m.step(timed);
+
+        const double total = elapsed();
+        evalMicros = inEval / rows;
+        serialMicros = std::max(0.0, total - inEval) / rows;
+
+        EvalTeam team(nullptr, std::min(threads, 4), threads);
+        const int rounds = 100;
+
+        start = std::chrono::steady_clock::now();
+        for (int r=0;r!=rounds;++r)
+            team.run([](int const) { });
+        dispatchMicros = elapsed() / rounds;
+
+        choose();
+    }
+
+    void
+    display() const
+    {
+        print("Planner: eval", evalMicros, "us, serial", serialMicros, "us, dispatch", dispatchMicros, "us per batch");
+        print("Planner:", runners, "concurrent runs x", width, "threads, estimated", estimateMillis(runners), "ms");
+    }
+
+    // Runs job(run, team) for every run on runners threads. The team of a
+    // run starts with width members and grows when threads become idle.
+    template <typename JOB>
+    void
+    execute(int const maxSize,
+            JOB job) const
+    {
+        ThreadBudget budget(threads - runners, runs);
+        std::atomic<int> next(0);
+        vector<std::thread> workers;
+
+        for (int w=0;w!=runners;++w)
+        {
+            workers.push_back(std::thread([&]() {
+                for (int jid=next++;jid<runs;jid=next++)
+                {
+                    budget.waiting -= 1;
+                    EvalTeam team(&budget, width, maxSize);
+                    job(jid, team);
+                }
+
+                budget.release(1);
+            }));
+        }
+
+        for (auto & t : workers)
+            t.join();
+    }
+};
+
+#endif // PLANNER_HPP
@@ -1,14 +1,19 @@
 #ifndef POPULATION_HPP
 #define POPULATION_HPP
 
+#include "matrix.hpp"
 #include "weight.hpp"
 
-typedef Bundle<Precision> Particles;
-typedef Bundle<Precision> Velocities;
+typedef Matrix<Precision> Particles;
+typedef Matrix<Precision> Velocities;
 typedef vector<Weight> Weights;
 typedef vector<Precision> Fitness;
+typedef vector<Precision> Violations;
 typedef vector<bool> Refreshes;
 
+// The rows are allocated once for the largest population a run may reach and
+// only the first size() rows are active, so resizing never reallocates.
+// With a storage directory, particles and velocities are kept out of core.
 class Population
 {
 public:
@@ -16,13 +21,15 @@ public:
     Particles particles;
     Velocities velocity;
     Weights weights;
+    uint active;
 
 public:
 
-    Population(const int popSize, const int dims) :
-        particles(popSize, dims, 0),
-        velocity(popSize, dims, 0),
-        weights(popSize)
+    Population(const int popSize, const int dims, std::string const & storage="") :
+        particles(popSize, dims, 0, storage),
+        velocity(popSize, dims, 0, storage),
+        weights(popSize),
+        active(popSize)
     {
 
     }
@@ -30,10 +37,12 @@ public:
     void
     cloneFrom(const Population & other)
     {
-        for (size_t i=0;i!=particles.numRows();++i)
+        active = other.active;
+
+        for (size_t i=0;i!=active;++i)
             weights[i] = other.weights[i];
 
-        for (size_t i=0;i!=particles.numRows();++i)
+        for (size_t i=0;i!=active;++i)
             for (size_t j=0;j!=particles.numCols();++j)
             {
                 particles(i,j) = other.particles(i,j);
@@ -46,8 +55,51 @@ public:
 //        copy(other.fitness.begin(), other.fitness.end(), fitness.begin());
     }
 
+    // Only the active size and the weights, for kernels that write every
+    // active row themselves
+    void
+    cloneWeightsFrom(const Population & other)
+    {
+        active = other.active;
+        std::copy(other.weights.begin(), other.weights.begin() + active, weights.begin());
+    }
+
+    void
+    resize(uint const n)
+    {
+        if (n > capacity())
+            error("Population size above its capacity:", n);
+        active = n;
+    }
+
+    void
+    moveRow(uint const src,
+            uint const dst)
+    {
+        if (src == dst)
+            return;
+
+        std::copy(&particles(src,0), &particles(src,0) + dims(), &particles(dst,0));
+        std::copy(&velocity(src,0), &velocity(src,0) + dims(), &velocity(dst,0));
+        weights[dst] = weights[src];
+    }
+
+    // Drops the resident pages of an out of core population
+    void
+    release()
+    {
+        particles.release(0, capacity());
+        velocity.release(0, capacity());
+    }
+
     uint
     size() const
+    {
+        return active;
+    }
+
+    uint
+    capacity() const
     {
         return particles.numRows();
     }
@@ -0,0 +1,68 @@
+#ifndef RACE_HPP
+#define RACE_HPP
+
+#include "cdeepso_params.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+// Best feasible fitness shared by the runs of a race. Runs publish their
+// improvements with a compare and swap and read the leader with a relaxed
+// load once per generation, so the board never blocks a worker.
+//
+// All runs stop once the leader reaches p.raceTarget. After p.raceCheck of
+// its budget, a run whose best is more than p.raceRatio times the leader's is
+// hopeless and is killed, its worker then starts a new seed.
+class RaceBoard
+{
+public:
+
+    CDEEPSOParams const & p;
+
+    std::atomic<Precision> best;
+    std::atomic<bool> finished;
+    std::atomic<int> kills;
+
+public:
+
+    RaceBoard(CDEEPSOParams const & p) :
+        p(p),
+        best(std::numeric_limits<Precision>::infinity()),
+        finished(false),
+        kills(0)
+    {
+
+    }
+
+    void
+    publish(Precision const fit)
+    {
+        Precision current = best.load(std::memory_order_relaxed);
+
+        while (fit < current && !best.compare_exchange_weak(current, fit, std::memory_order_relaxed))
+            ;
+
+        if (fit <= p.raceTarget)
+            finished.store(true, std::memory_order_relaxed);
+    }
+
+    bool
+    isFinished() const
+    {
+        return finished.load(std::memory_order_relaxed);
+    }
+
+    bool
+    isHopeless(int const fitEval,
+               Precision const fit) const
+    {
+        if (fitEval < p.raceCheck * p.maxFitEval)
+            return false;
+
+        const Precision leader = best.load(std::memory_order_relaxed);
+        return fit - leader > (p.raceRatio - 1.0) * std::abs(leader);
+    }
+};
+
+#endif // RACE_HPP
@@ -0,0 +1,96 @@
+#ifndef RNG_HPP
+#define RNG_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+// Random number generator owned by each optimizer instance. It exposes the
+// same methods used from wup's base_random, but every instance has its own
+// engine and can be seeded, so runs executing in parallel do not share state
+// and a run can be replayed from its seed.
+class Random
+{
+public:
+
+    std::mt19937_64 engine;
+    std::normal_distribution<double> normal;
+
+public:
+
+    // seed 0 picks a fresh seed, different for every instance
+    Random(uint64_t const seed=0) :
+        engine(seed ? seed : freshSeed())
+    {
+
+    }
+
+    void
+    seed(uint64_t const seed)
+    {
+        engine.seed(seed ? seed : freshSeed());
+        normal.reset();
+    }
+
+    double
+    uniformDouble()
+    {
+        return (engine() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    double
+    normalDouble()
+    {
+        return normal(engine);
+    }
+
+    bool
+    unfairCoin(double const p)
+    {
+        return uniformDouble() < p;
+    }
+
+    int
+    uniformInt(int const n)
+    {
+        return int(uniformDouble() * n);
+    }
+
+    template <typename T>
+    void
+    shuffle(std::vector<T> & data)
+    {
+        for (size_t i=data.size();i>1;--i)
+            std::swap(data[i-1], data[uniformInt(i)]);
+    }
+
+    // Seed of an independent stream derived from seed, 0 stays 0
+    static uint64_t
+    derive(uint64_t const seed,
+           uint64_t const stream)
+    {
+        return seed ? mix(seed + 0x9E3779B97F4A7C15ULL * (stream + 1)) : 0;
+    }
+
+    static uint64_t
+    freshSeed()
+    {
+        static std::atomic<uint64_t> counter(
+                    std::chrono::high_resolution_clock::now().time_since_epoch().count());
+        return mix(counter.fetch_add(0x9E3779B97F4A7C15ULL));
+    }
+
+    // splitmix64 finalizer
+    static uint64_t
+    mix(uint64_t z)
+    {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        z = z ^ (z >> 31);
+        return z ? z : 1;
+    }
+};
+
+#endif // RNG_HPP
@@ -0,0 +1,281 @@
+#ifndef ROTATED_HPP
+#define ROTATED_HPP
+
+#include "functions.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+// Shift o and rotation M of a CEC style benchmark, z = M (x - o). Both are
+// read from binary files of native doubles, dims values for the shift and
+// dims x dims row-major values for the rotation. A missing file name draws
+// them from seed instead: o uniform in the central 80% of [xMin, xMax] and M a
+// random orthogonal matrix. One instance is built per problem and only read
+// afterwards, so every run of the pool shares it.
+class ShiftRotation
+{
+public:
+
+    int dims;
+    vector<Precision> shift;
+    Bundle<Precision> rotation;
+
+public:
+
+    ShiftRotation(CDEEPSOParams const & p) :
+        dims(p.dims),
+        shift(p.dims),
+        rotation(p.dims, p.dims, 0.0)
+    {
+        Random generator(p.suiteSeed);
+
+        if (p.shiftFile.empty())
+            for (int j=0;j!=dims;++j)
+                shift[j] = 0.5 * (p.xMin + p.xMax) + 0.8 * (generator.uniformDouble() - 0.5) * (p.xMax - p.xMin);
+        else
+            load(p.shiftFile, &shift[0], dims);
+
+        if (p.rotationFile.empty())
+            randomRotation(generator);
+        else
+            load(p.rotationFile, &rotation(0,0), dims * dims);
+    }
+
+    // Hash of the values of o and M, tells transforms apart whatever seed or
+    // files they came from
+    uint64_t
+    fingerprint() const
+    {
+        uint64_t h = 0x9E3779B97F4A7C15ULL;
+
+        for (Precision const * v=shift.data();v!=shift.data()+dims;++v)
+            h = Random::mix(h ^ bits(*v));
+
+        for (Precision const * v=rotation.begin();v!=rotation.end();++v)
+            h = Random::mix(h ^ bits(*v));
+
+        return h;
+    }
+
+    // z = y M^T + offset for the first n rows of y, that hold x - o. A cache
+    // blocked matrix-matrix product: a 4 x 2 tile of z is accumulated in
+    // registers over a panel of innerBlock columns, so every element of M
+    // loaded serves four particles.
+    void
+    apply(Bundle<Precision> const & y,
+          Bundle<Precision> & z,
+          int const n,
+          Precision const offset) const
+    {
+        static const int innerBlock = 128;
+
+        for (int i=0;i!=n;++i)
+            for (int j=0;j!=dims;++j)
+                z(i,j) = offset;
+
+        for (int i=0;i<n;i+=4)
+        {
+            for (int k0=0;k0<dims;k0+=innerBlock)
+            {
+                const int k1 = std::min(k0 + innerBlock, dims);
+
+                for (int j=0;j<dims;j+=2)
+                {
+                    if (i + 4 <= n && j + 2 <= dims)
+                    {
+                        tile(y, z, i, j, k0, k1);
+                        continue;
+                    }
+
+                    for (int r=i;r!=std::min(i + 4, n);++r)
+                    {
+                        for (int c=j;c!=std::min(j + 2, dims);++c)
+                        {
+                            Precision sum = 0.0;
+                            for (int k=k0;k!=k1;++k)
+                                sum += y(r,k) * rotation(c,k);
+                            z(r,c) += sum;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+private:
+
+    void
+    tile(Bundle<Precision> const & y,
+         Bundle<Precision> & z,
+         int const i,
+         int const j,
+         int const k0,
+         int const k1) const
+    {
+        Precision const * const y0 = &y(i,0);
+        Precision const * const y1 = &y(i+1,0);
+        Precision const * const y2 = &y(i+2,0);
+        Precision const * const y3 = &y(i+3,0);
+        Precision const * const m0 = &rotation(j,0);
+        Precision const * const m1 = &rotation(j+1,0);
+
+        Precision a00 = 0.0, a01 = 0.0, a10 = 0.0, a11 = 0.0;
+        Precision a20 = 0.0, a21 = 0.0, a30 = 0.0, a31 = 0.0;
+
+        for (int k=k0;k!=k1;++k)
+        {
+            const Precision b0 = m0[k];
+            const Precision b1 = m1[k];
+
+            a00 += y0[k] * b0; a01 += y0[k] * b1;
+            a10 += y1[k] * b0; a11 += y1[k] * b1;
+            a20 += y2[k] * b0; a21 += y2[k] * b1;
+            a30 += y3[k] * b0; a31 += y3[k] * b1;
+        }
+
+        z(i,j) += a00; z(i,j+1) += a01;
+        z(i+1,j) += a10; z(i+1,j+1) += a11;
+        z(i+2,j) += a20; z(i+2,j+1) += a21;
+        z(i+3,j) += a30; z(i+3,j+1) += a31;
+    }
+
+    static uint64_t
+    bits(Precision const v)
+    {
+        uint64_t b;
+        std::memcpy(&b, &v, sizeof(b));
+        return b;
+    }
+
+    static void
+    load(std::string const & filename,
+         Precision * const values,
+         int const n)
+    {
+        std::ifstream in(filename, std::ios::binary);
+
+        if (!in.good())
+            error("Could not open transform file:", filename);
+
+        vector<double> raw(n);
+        in.read(reinterpret_cast<char*>(&raw[0]), n * sizeof(double));
+
+        if (in.gcount() != std::streamsize(n * sizeof(double)) || in.peek() != EOF)
+            error("Transform file must hold", n, "doubles:", filename);
+
+        std::copy(raw.begin(), raw.end(), values);
+    }
+
+    // Gram-Schmidt on the rows of a gaussian matrix
+    void
+    randomRotation(Random & generator)
+    {
+        Bundle<Precision> & m = rotation;
+
+        for (int i=0;i!=dims;++i)
+        {
+            Precision norm = 0.0;
+
+            while (norm < 1e-8)
+            {
+                for (int j=0;j!=dims;++j)
+                    m(i,j) = generator.normalDouble();
+
+                for (int r=0;r!=i;++r)
+                {
+                    Precision dot = 0.0;
+                    for (int j=0;j!=dims;++j)
+                        dot += m(i,j) * m(r,j);
+                    for (int j=0;j!=dims;++j)
+                        m(i,j) -= dot * m(r,j);
+                }
+
+                norm = 0.0;
+                for (int j=0;j!=dims;++j)
+                    norm += m(i,j) * m(i,j);
+                norm = std::sqrt(norm);
+            }
+
+            for (int j=0;j!=dims;++j)
+                m(i,j) /= norm;
+        }
+    }
+};
+
+// Shifted and rotated variant of a particle function. The refreshed rows are
+// gathered, transformed together by ShiftRotation::apply and then evaluated.
+// The scratch buffers belong to each copy, so every run owns its own.
+class RotatedEval
+{
+public:
+
+    ShiftRotation const * transform;
+    Objective::Function function;
+    Precision offset;
+
+    Bundle<Precision> y;
+    Bundle<Precision> z;
+    vector<int> rows;
+
+public:
+
+    RotatedEval(ShiftRotation const & transform,
+                Objective::Function function,
+                Precision const offset) :
+        transform(&transform),
+        function(function),
+        offset(offset)
+    {
+
+    }
+
+    void
+    operator()(Particles & particles,
+               Refreshes & refresh,
+               Fitness & fitness)
+    {
+        const int dims = transform->dims;
+
+        rows.clear();
+        for (uint i=0;i!=particles.numRows();++i)
+            if (refresh[i])
+                rows.push_back(i);
+
+        const int n = rows.size();
+
+        if (int(y.numRows()) < n)
+        {
+            y = Bundle<Precision>(n, dims, 0.0);
+            z = Bundle<Precision>(n, dims, 0.0);
+        }
+
+        for (int r=0;r!=n;++r)
+            for (int j=0;j!=dims;++j)
+                y(r,j) = particles(rows[r],j) - transform->shift[j];
+
+        transform->apply(y, z, n, offset);
+
+        for (int r=0;r!=n;++r)
+            fitness[rows[r]] = function(&z(r,0), dims);
+    }
+};
+
+// Base function of a rotated benchmark, rosenbrock is moved so that its
+// optimum falls on the shift
+inline bool
+findRotated(std::string const & name,
+            Objective::Function & function,
+            Precision & offset)
+{
+    offset = 0.0;
+
+    if (name == "sras") function = rastrigin;
+    else if (name == "sgri") function = griewank;
+    else if (name == "sros") { function = rosenbrock; offset = 1.0; }
+    else return false;
+
+    return true;
+}
+
+#endif // ROTATED_HPP
@@ -0,0 +1,433 @@
+#ifndef SHARED_HPP
+#define SHARED_HPP
+
+#include "constraints.hpp"
+#include "delta.hpp"
+#include "population.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+// Archive in a memory mapped file shared by every run of every process that
+// opens the same file. It holds
+//
+//   top    the best feasible solutions published by the runs, used to
+//          migrate solutions between processes
+//   cache  a hash table of evaluated points, so a point evaluated by any
+//          process is not evaluated again
+//
+// Every slot is guarded by its own sequence lock: a writer takes the slot by
+// moving its sequence from even to odd with a CAS and gives up if another
+// writer holds it, readers retry when the sequence changed while copying. No
+// call ever blocks. The atomics are GCC builtins on the mapped words, since
+// std::atomic objects cannot be placed in a file.
+class SharedArchive
+{
+public:
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t state;
+        uint32_t dims;
+        uint32_t topSize;
+        uint64_t cacheSize;
+        uint64_t tag;
+    };
+
+    static const uint32_t EMPTY = 0;
+    static const uint32_t INITIALIZING = 1;
+    static const uint32_t READY = 2;
+
+    int dims;
+    int topSize;
+    uint64_t cacheSize;
+    size_t slotWords;
+    size_t bytes;
+
+    uint8_t * data;
+    Header * header;
+    uint64_t * top;
+    uint64_t * cache;
+
+    std::atomic<long> cacheHits;
+    std::atomic<long> cacheMisses;
+
+public:
+
+    // tag identifies the objective, files created for another one are refused.
+    // A topSize or cacheSize of 0 turns the top list or the cache off.
+    SharedArchive(std::string const & filename,
+                  int const dims,
+                  int const topSize,
+                  int const cacheSize,
+                  std::string const & tag) :
+        dims(dims),
+        topSize(topSize),
+        cacheSize(cacheSize),
+        slotWords(3 + dims),
+        bytes(sizeof(Header) + (topSize + uint64_t(cacheSize)) * slotWords * sizeof(uint64_t)),
+        cacheHits(0),
+        cacheMisses(0)
+    {
+        if (topSize < 0 || cacheSize < 0)
+            error("Shared archive sizes must not be negative:", topSize, cacheSize);
+
+        const int fd = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+
+        if (fd < 0)
+            error("Could not open shared archive:", filename);
+
+        struct stat st;
+        fstat(fd, &st);
+
+        if (st.st_size == 0 && ftruncate(fd, bytes) != 0)
+            error("Could not size shared archive:", filename);
+
+        fstat(fd, &st);
+        if (size_t(st.st_size) != bytes)
+            error("Shared archive has another layout:", filename);
+
+        void * const mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+
+        if (mem == MAP_FAILED)
+            error("Could not map shared archive:", filename);
+
+        data = static_cast<uint8_t*>(mem);
+        header = reinterpret_cast<Header*>(data);
+        top = reinterpret_cast<uint64_t*>(data + sizeof(Header));
+        cache = top + topSize * slotWords;
+
+        initHeader(hashString(tag));
+    }
+
+    ~SharedArchive()
+    {
+        munmap(data, bytes);
+    }
+
+    // Slot layout: sequence, fitness, violation, position
+    uint64_t *
+    topSlot(int const i) const
+    {
+        return top + i * slotWords;
+    }
+
+    uint64_t *
+    cacheSlot(uint64_t const i) const
+    {
+        return cache + i * slotWords;
+    }
+
+    // Offers a solution to the top list, it replaces the worst entry when
+    // better than it
+    void
+    publish(Precision const * const x,
+            Precision const fit)
+    {
+        int target = -1;
+        Precision worst = -std::numeric_limits<Precision>::infinity();
+
+        for (int i=0;i!=topSize;++i)
+        {
+            uint64_t * const slot = topSlot(i);
+            const uint64_t seq = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+
+            if (seq == 0)
+            {
+                target = i;
+                break;
+            }
+
+            const Precision f = loadPrecision(slot + 1);
+
+            if (f == fit)
+                return;
+
+            if (f > worst)
+            {
+                worst = f;
+                target = i;
+            }
+        }
+
+        if (target >= 0 && (worst == -std::numeric_limits<Precision>::infinity() || fit < worst))
+            write(topSlot(target), x, fit, 0.0);
+    }
+
+    // Copies a random top entry, returns false when none could be read
+    bool
+    sample(Random & generator,
+           Precision * const x,
+           Precision & fit)
+    {
+        if (topSize == 0)
+            return false;
+
+        const int start = generator.uniformInt(topSize);
+
+        for (int k=0;k!=topSize;++k)
+        {
+            Precision viol;
+            if (read(topSlot((start + k) % topSize), x, fit, viol))
+                return true;
+        }
+
+        return false;
+    }
+
+    bool
+    lookup(Precision const * const x,
+           Precision & fit,
+           Precision & viol)
+    {
+        if (cacheSize == 0)
+            return false;
+
+        if (matches(cacheSlot(hashPoint(x) % cacheSize), x, fit, viol))
+        {
+            cacheHits.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        cacheMisses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    void
+    store(Precision const * const x,
+          Precision const fit,
+          Precision const viol)
+    {
+        if (cacheSize == 0)
+            return;
+
+        write(cacheSlot(hashPoint(x) % cacheSize), x, fit, viol);
+    }
+
+private:
+
+    void
+    initHeader(uint64_t const tag)
+    {
+        uint32_t expected = EMPTY;
+
+        if (__atomic_compare_exchange_n(&header->state, &expected, INITIALIZING, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        {
+            std::memcpy(header->magic, "CDSA", 4);
+            header->dims = dims;
+            header->topSize = topSize;
+            header->cacheSize = cacheSize;
+            header->tag = tag;
+            __atomic_store_n(&header->state, READY, __ATOMIC_RELEASE);
+        }
+
+        while (__atomic_load_n(&header->state, __ATOMIC_ACQUIRE) != READY)
+            std::this_thread::yield();
+
+        if (std::memcmp(header->magic, "CDSA", 4) != 0 || header->dims != uint32_t(dims) ||
+                header->topSize != uint32_t(topSize) || header->cacheSize != cacheSize)
+            error("Shared archive has another layout");
+
+        if (header->tag != tag)
+            error("Shared archive belongs to another objective");
+    }
+
+    void
+    write(uint64_t * const slot,
+          Precision const * const x,
+          Precision const fit,
+          Precision const viol)
+    {
+        uint64_t seq = __atomic_load_n(slot, __ATOMIC_RELAXED);
+
+        if ((seq & 1) || !__atomic_compare_exchange_n(slot, &seq, seq + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return;
+
+        storePrecision(slot + 1, fit);
+        storePrecision(slot + 2, viol);
+        for (int j=0;j!=dims;++j)
+            storePrecision(slot + 3 + j, x[j]);
+
+        __atomic_store_n(slot, seq + 2, __ATOMIC_RELEASE);
+    }
+
+    bool
+    read(uint64_t * const slot,
+         Precision * const x,
+         Precision & fit,
+         Precision & viol) const
+    {
+        for (int attempt=0;attempt!=4;++attempt)
+        {
+            const uint64_t before = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+
+            if (before == 0)
+                return false;
+
+            if (before & 1)
+                continue;
+
+            fit = loadPrecision(slot + 1);
+            viol = loadPrecision(slot + 2);
+            for (int j=0;j!=dims;++j)
+                x[j] = loadPrecision(slot + 3 + j);
+
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+            if (__atomic_load_n(slot, __ATOMIC_RELAXED) == before)
+                return true;
+        }
+
+        return false;
+    }
+
+    // Reads the fitness of slot when it holds exactly x
+    bool
+    matches(uint64_t * const slot,
+            Precision const * const x,
+            Precision & fit,
+            Precision & viol) const
+    {
+        const uint64_t before = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+
+        if (before == 0 || (before & 1))
+            return false;
+
+        for (int j=0;j!=dims;++j)
+            if (loadPrecision(slot + 3 + j) != x[j])
+                return false;
+
+        fit = loadPrecision(slot + 1);
+        viol = loadPrecision(slot + 2);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        return __atomic_load_n(slot, __ATOMIC_RELAXED) == before;
+    }
+
+    static Precision
+    loadPrecision(uint64_t const * const word)
+    {
+        const uint64_t bits = __atomic_load_n(word, __ATOMIC_RELAXED);
+        Precision v;
+        std::memcpy(&v, &bits, sizeof(v));
+        return v;
+    }
+
+    static void
+    storePrecision(uint64_t * const word,
+                   Precision const v)
+    {
+        uint64_t bits;
+        std::memcpy(&bits, &v, sizeof(v));
+        __atomic_store_n(word, bits, __ATOMIC_RELAXED);
+    }
+
+    uint64_t
+    hashPoint(Precision const * const x) const
+    {
+        uint64_t h = 0x9E3779B97F4A7C15ULL;
+        for (int j=0;j!=dims;++j)
+        {
+            uint64_t bits;
+            std::memcpy(&bits, &x[j], sizeof(bits));
+            h = Random::mix(h ^ bits);
+        }
+        return h;
+    }
+
+    static uint64_t
+    hashString(std::string const & s)
+    {
+        uint64_t h = 0x9E3779B97F4A7C15ULL;
+        for (char c : s)
+            h = Random::mix(h ^ uint8_t(c));
+        return h;
+    }
+};
+
+// Evaluator that answers from the shared cache first. Hits clear their refresh
+// flag, so they do not count as fitness evaluations, and the misses are
+// evaluated by EVAL and stored for everyone.
+template <typename EVAL>
+class SharedCachedEval
+{
+public:
+
+    EVAL eval;
+    SharedArchive & archive;
+
+public:
+
+    SharedCachedEval(EVAL eval, SharedArchive & archive) :
+        eval(eval),
+        archive(archive)
+    {
+
+    }
+
+    void
+    lookup(Particles & particles,
+           Refreshes & refresh,
+           Fitness & fitness,
+           Violations & violation)
+    {
+        for (uint i=0;i!=refresh.size();++i)
+            if (refresh[i] && archive.lookup(&particles(i,0), fitness[i], violation[i]))
+                refresh[i] = false;
+    }
+
+    void
+    store(Particles & particles,
+          Refreshes & refresh,
+          Fitness & fitness,
+          Violations & violation)
+    {
+        for (uint i=0;i!=refresh.size();++i)
+            if (refresh[i])
+                archive.store(&particles(i,0), fitness[i], violation[i]);
+    }
+};
+
+template <typename EVAL>
+SharedCachedEval<EVAL>
+sharedCached(EVAL eval, SharedArchive & archive)
+{
+    return SharedCachedEval<EVAL>(eval, archive);
+}
+
+template <typename EVAL>
+void
+evaluate(SharedCachedEval<EVAL> & cached,
+         Particles & particles,
+         Refreshes & refresh,
+         Fitness & fitness,
+         Violations & violation)
+{
+    cached.lookup(particles, refresh, fitness, violation);
+    evaluate(cached.eval, particles, refresh, fitness, violation);
+    cached.store(particles, refresh, fitness, violation);
+}
+
+template <typename EVAL>
+void
+evaluateNear(SharedCachedEval<EVAL> & cached,
+             Particles & particles,
+             Refreshes & refresh,
+             Fitness & fitness,
+             Violations & violation,
+             Particles const & reference)
+{
+    cached.lookup(particles, refresh, fitness, violation);
+    evaluateNear(cached.eval, particles, refresh, fitness, violation, reference);
+    cached.store(particles, refresh, fitness, violation);
+}
+
+#endif // SHARED_HPP
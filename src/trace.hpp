@@ -0,0 +1,124 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include "population.hpp"
+
+#include <cmath>
+#include <fstream>
+#include <limits>
+
+// Best-so-far fitness of one run at a fixed number of log-spaced fitEval
+// checkpoints between firstEval and lastEval. All memory is allocated in the
+// constructor. A checkpoint receives the best fitness known when the optimizer
+// first reports a fitEval at or past it, so its resolution is one generation.
+class ConvergenceTrace
+{
+public:
+
+    vector<int> checkpoints;
+    vector<Precision> values;
+    uint next;
+
+public:
+
+    ConvergenceTrace(int const points,
+                     int const firstEval,
+                     int const lastEval) :
+        checkpoints(points),
+        values(points, std::numeric_limits<Precision>::quiet_NaN()),
+        next(0)
+    {
+        const double ratio = double(std::max(lastEval, firstEval + 1)) / std::max(firstEval, 1);
+
+        for (int k=0;k!=points;++k)
+        {
+            const int c = int(std::round(std::max(firstEval, 1) * std::pow(ratio, points == 1 ? 1.0 : double(k) / (points - 1))));
+            checkpoints[k] = k == 0 ? c : std::max(c, checkpoints[k-1] + 1);
+        }
+    }
+
+    uint
+    size() const
+    {
+        return checkpoints.size();
+    }
+
+    bool
+    due(int const fitEval) const
+    {
+        return next != size() && checkpoints[next] <= fitEval;
+    }
+
+    void
+    record(int const fitEval,
+           Precision const best)
+    {
+        while (due(fitEval))
+            values[next++] = best;
+    }
+
+    // Checkpoints the run did not reach keep its final best
+    void
+    finish(Precision const best)
+    {
+        while (next != size())
+            values[next++] = best;
+    }
+};
+
+// Traces of all runs, one preallocated row per run. Every worker only writes
+// the row of its own run, so no locking is needed.
+class TraceTable
+{
+public:
+
+    vector<int> checkpoints;
+    Bundle<Precision> values;
+
+public:
+
+    TraceTable(int const runs,
+               ConvergenceTrace const & layout) :
+        checkpoints(layout.checkpoints),
+        values(runs, layout.size(), std::numeric_limits<Precision>::quiet_NaN())
+    {
+
+    }
+
+    void
+    store(int const run,
+          ConvergenceTrace const & trace)
+    {
+        if (trace.size() != values.numCols())
+            error("Trace size does not match the table");
+
+        std::copy(trace.values.begin(), trace.values.end(), &values(run,0));
+    }
+
+    // Columnar CSV: one line per checkpoint, one column per run
+    void
+    write(std::string const & filename) const
+    {
+        std::ofstream out(filename);
+
+        if (!out.good())
+            error("Could not write trace file:", filename);
+
+        out << "fitEval";
+        for (uint r=0;r!=values.numRows();++r)
+            out << ",run" << r;
+        out << "\n";
+
+        out.precision(10);
+
+        for (uint k=0;k!=checkpoints.size();++k)
+        {
+            out << checkpoints[k];
+            for (uint r=0;r!=values.numRows();++r)
+                out << "," << values(r,k);
+            out << "\n";
+        }
+    }
+};
+
+#endif // TRACE_HPP
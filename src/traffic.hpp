@@ -0,0 +1,274 @@
+#ifndef TRAFFIC_HPP
+#define TRAFFIC_HPP
+
+#include "planner.hpp"
+
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Bytes the calling thread moved between the last level cache and memory,
+// counted as read and write misses of the last level cache through
+// perf_event_open, one cache line per miss. available() is false where the
+// kernel does not expose the hardware counters, e.g. in most VMs or with a
+// high perf_event_paranoid.
+class MemoryCounter
+{
+public:
+
+    int fds[2];
+    long lineSize;
+
+public:
+
+    MemoryCounter()
+    {
+        fds[0] = openEvent(PERF_COUNT_HW_CACHE_OP_READ);
+        fds[1] = openEvent(PERF_COUNT_HW_CACHE_OP_WRITE);
+
+        lineSize = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+        if (lineSize <= 0)
+            lineSize = 64;
+    }
+
+    ~MemoryCounter()
+    {
+        for (int fd : fds)
+            if (fd >= 0)
+                close(fd);
+    }
+
+    bool
+    available() const
+    {
+        return fds[0] >= 0;
+    }
+
+    void
+    reset()
+    {
+        control(PERF_EVENT_IOC_RESET);
+    }
+
+    void
+    enable()
+    {
+        control(PERF_EVENT_IOC_ENABLE);
+    }
+
+    void
+    disable()
+    {
+        control(PERF_EVENT_IOC_DISABLE);
+    }
+
+    double
+    bytes() const
+    {
+        double misses = 0.0;
+
+        for (int fd : fds)
+        {
+            uint64_t count = 0;
+            if (fd >= 0 && read(fd, &count, sizeof(count)) == sizeof(count))
+                misses += count;
+        }
+
+        return misses * lineSize;
+    }
+
+private:
+
+    static int
+    openEvent(uint64_t const op)
+    {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_LL | (op << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+    void
+    control(unsigned long const request)
+    {
+        for (int fd : fds)
+            if (fd >= 0)
+                ioctl(fd, request, 0);
+    }
+};
+
+// Pauses the memory counter while EVAL runs, so the bytes are the optimizer's
+template <typename EVAL>
+class UncountedEval
+{
+public:
+
+    EVAL eval;
+    MemoryCounter * counter;
+
+public:
+
+    UncountedEval(EVAL eval,
+                  MemoryCounter * counter) :
+        eval(eval),
+        counter(counter)
+    {
+
+    }
+};
+
+template <typename EVAL>
+void
+evaluate(UncountedEval<EVAL> & ue,
+         Particles & particles,
+         Refreshes & refresh,
+         Fitness & fitness,
+         Violations & violation)
+{
+    ue.counter->disable();
+    evaluate(ue.eval, particles, refresh, fitness, violation);
+    ue.counter->enable();
+}
+
+template <typename EVAL>
+void
+evaluateNear(UncountedEval<EVAL> & ue,
+             Particles & particles,
+             Refreshes & refresh,
+             Fitness & fitness,
+             Violations & violation,
+             Particles const & reference)
+{
+    ue.counter->disable();
+    evaluateNear(ue.eval, particles, refresh, fitness, violation, reference);
+    ue.counter->enable();
+}
+
+// Optimizer cost of a generation without and with the fused kernels, at the
+// popSize and dims of the params. Both paths run the same generations from
+// the same seed through TimedEval, so the time spent in the evaluator is left
+// out. Where the hardware counters are available, the bytes moved to and
+// from memory are measured with MemoryCounter, outside the evaluator too.
+//
+// Next to the measure, and in its place without counters, the modeled bytes
+// are the rows each pass streams if no row stays in cache, one row being
+// dims values, per particle and generation:
+//
+//   regular  heuristic: 5 for a new row (three donors, the personal best and
+//            the written row) or 4 for a copied one, then limits 4
+//            mutated weights: clone 4, velocity 4, position 3, limits 4
+//            velocity update: velocity 4, position 3, limits 4
+//   fused    heuristic: 5 + 2 (limits on the velocity) for a new row only
+//            mutated weights: 5, velocity update: 5
+//
+// The copies of the selection are the same in both paths and are left out.
+// The model follows from the code of the passes, it is not a result.
+class TrafficBenchmark
+{
+public:
+
+    CDEEPSOParams p;
+
+    double millis[2];
+    double measured[2];
+    double modeled[2];
+    bool counted;
+    Precision gBestFit[2];
+
+public:
+
+    TrafficBenchmark(CDEEPSOParams const & p) :
+        p(p),
+        counted(false)
+    {
+        this->p.printConvergenceResults = 0;
+        this->p.localSearch = CDEEPSOParams::LocalSearch::NONE;
+        this->p.popSizing = CDEEPSOParams::PopSizing::FIXED;
+
+        // A fresh seed would differ between the two paths
+        if (!this->p.seed)
+            this->p.seed = 1;
+    }
+
+    template <typename EVAL>
+    void
+    run(EVAL eval)
+    {
+        const double n = p.popSize;
+        const double row = double(p.dims) * sizeof(Precision);
+
+        MemoryCounter counter;
+        counted = counter.available();
+
+        for (int fused=0;fused!=2;++fused)
+        {
+            CDEEPSOParams cp = p;
+            cp.fused = fused;
+
+            double inEval = 0.0;
+            long rows = 0;
+            TimedEval<UncountedEval<EVAL>> timed(UncountedEval<EVAL>(eval, &counter), &inEval, &rows);
+            CDEEPSO m(cp);
+
+            m.start(timed);
+            inEval = 0.0;
+            rows = 0;
+
+            counter.reset();
+            counter.enable();
+
+            auto start = std::chrono::steady_clock::now();
+            for (int g=0;g!=p.trafficBench;++g)
+                m.step(timed);
+            const double total = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            counter.disable();
+
+            // Evaluated rows per generation are the new heuristic rows plus
+            // the two full populations
+            const double fresh = std::max(0.0, double(rows) / p.trafficBench - 2 * n);
+
+            millis[fused] = (total - inEval / 1000.0) / p.trafficBench;
+            measured[fused] = counter.bytes() / p.trafficBench;
+            modeled[fused] = fused
+                    ? row * (7 * fresh + 10 * n)
+                    : row * (9 * fresh + 8 * (n - fresh) + 26 * n);
+            gBestFit[fused] = m.gBestFit;
+        }
+    }
+
+    void
+    display() const
+    {
+        print("Traffic:", p.popSize, "particles x", p.dims, "dims,", p.trafficBench, "generations");
+
+        for (int fused=0;fused!=2;++fused)
+        {
+            if (counted)
+                print(fused ? "  Fused:" : "  Regular:", millis[fused], "ms,", measured[fused] / 1e6, "MB measured,", modeled[fused] / 1e6, "MB modeled per generation");
+            else
+                print(fused ? "  Fused:" : "  Regular:", millis[fused], "ms,", modeled[fused] / 1e6, "MB modeled per generation");
+        }
+
+        print("  Speedup:", millis[0] / millis[1]);
+
+        if (counted)
+            print("  Measured traffic ratio:", measured[0] / measured[1]);
+        else
+            print("  No memory counters on this machine, the traffic is only modeled");
+
+        print("  Modeled traffic ratio:", modeled[0] / modeled[1]);
+        print("  Same gBest:", gBestFit[0] == gBestFit[1] ? "yes" : "no");
+    }
+};
+
+#endif // TRAFFIC_HPP
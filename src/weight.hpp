@@ -4,6 +4,8 @@
 #include "cdeepso_params.hpp"
 
 #include <wup/wup.hpp>
+#include <array>
+#include <cmath>
 #include <vector>
 
 using namespace wup;
@@ -78,4 +80,101 @@ public:
 
 };
 
+// Success history of the strategic parameters (SHADE). Every weight that
+// produced an improvement is recorded with the size of the improvement. At
+// the end of a generation the next memory slot receives the mean of each
+// parameter weighted by the improvements, and new weights are drawn around a
+// random slot. dVelocity is stored as a fraction of maxVelocity.
+class WeightHistory
+{
+public:
+
+    typedef std::array<Precision, 6> Values;
+
+    vector<Values> memory;
+    vector<Values> successValues;
+    vector<Precision> successGains;
+    int slot;
+
+public:
+
+    WeightHistory(int const size,
+                  int const maxSuccesses)
+    {
+        Values middle;
+        middle.fill(0.5);
+        memory.assign(std::max(size, 1), middle);
+        successValues.reserve(maxSuccesses);
+        successGains.reserve(maxSuccesses);
+        slot = 0;
+    }
+
+    void
+    record(Weight const & w,
+           Precision const gain,
+           Precision const maxVelocity)
+    {
+        successValues.push_back({{w.pInertia, w.pMemory, w.pCooperation, w.pPerturbation,
+                                  w.dThreshold, w.dVelocity / maxVelocity}});
+        successGains.push_back(std::isfinite(gain) && gain > 0.0 ? gain : 1.0);
+    }
+
+    void
+    update()
+    {
+        if (successGains.empty())
+            return;
+
+        Precision total = 0.0;
+        for (Precision g : successGains)
+            total += g;
+
+        for (int k=0;k!=6;++k)
+        {
+            Precision num = 0.0;
+            Precision den = 0.0;
+
+            for (uint i=0;i!=successGains.size();++i)
+            {
+                num += successGains[i] * successValues[i][k] * successValues[i][k];
+                den += successGains[i] * successValues[i][k];
+            }
+
+            // Lehmer mean for the DE scale dVelocity, arithmetic for the rest
+            memory[slot][k] = k == 5 ? (den > 0.0 ? num / den : 0.0) : den / total;
+        }
+
+        slot = (slot + 1) % memory.size();
+        successValues.clear();
+        successGains.clear();
+    }
+
+    void
+    sample(Weight & w,
+           Random & generator,
+           Precision const scale,
+           Precision const maxVelocity) const
+    {
+        Values const & m = memory[generator.uniformInt(memory.size())];
+
+        w.pInertia = draw(m[0], scale, generator);
+        w.pMemory = draw(m[1], scale, generator);
+        w.pCooperation = draw(m[2], scale, generator);
+        w.pPerturbation = draw(m[3], scale, generator);
+        w.dThreshold = draw(m[4], scale, generator);
+        w.dVelocity = draw(m[5], scale, generator) * maxVelocity;
+    }
+
+    // Cauchy around the memory value, clamped to [0, 1]. The heavy tails keep
+    // the weights diverse, greedy selection alone drifts them towards 1.
+    static Precision
+    draw(Precision const mean,
+         Precision const scale,
+         Random & generator)
+    {
+        const Precision v = mean + scale * std::tan(M_PI * (generator.uniformDouble() - 0.5));
+        return v < 0.0 ? 0.0 : v > 1.0 ? 1.0 : v;
+    }
+};
+
 #endif // WEIGHTS_HPP